@@ -8,6 +8,15 @@
 #define N 1000
 #define L 32
 
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 int main()
 {
     uchar **strings = malloc(N * sizeof(uchar *));
@@ -29,7 +38,7 @@ int main()
 
     judy_create(&judy);
 
-    clock_t t0 = clock();
+    double t0 = _now();
 
     // insert strings
     for (int i = 0; i < N; ++i)
@@ -37,9 +46,9 @@ int main()
         judy_insert(&judy, strings[i], &judy);
     }
 
-    clock_t t1 = clock();
+    double t1 = _now();
 
-    printf("insertion time: %.fms\n", (double)(t1 - t0)/CLOCKS_PER_SEC * 1000);
+    printf("insertion time: %.3fms\n", (t1 - t0) * 1000);
 
     judy_delete(&judy);
 
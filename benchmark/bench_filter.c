@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <time.h>
+
+#include "../src/judy.h"
+
+// paths of user ids, queried with 0%, 70% and 100% misses
+#define N 1000000
+#define Q 1000000
+#define K 32
+#define RUNS 3
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double _run(judy_t *judy, uchar **queries, size_t *hits)
+{
+    double t0 = _now();
+
+    for (int i = 0; i < Q; ++i)
+        *hits += judy_lookup(judy, queries[i]) != NULL;
+
+    return (_now() - t0) / Q * 1e9;
+}
+
+static double _min(double a, double b)
+{
+    return a < b ? a : b;
+}
+
+int main()
+{
+    uchar *keys = malloc(N * (K + 1));
+    uchar *misses = malloc(N * (K + 1));
+
+    for (int i = 0; i < N; ++i)
+    {
+        int id = rand() % 100000000;
+
+        // a miss shares all but the last char with a key,
+        // so it fails only near the bottom of the tree
+        snprintf((char *)keys + i * (K + 1), K + 1, "/users/%08d/settings", id);
+        snprintf((char *)misses + i * (K + 1), K + 1, "/users/%08d/settingz", id);
+    }
+
+    judy_t plain;
+    judy_t filtered;
+
+    judy_create(&plain);
+    judy_create(&filtered);
+
+    judy_filter(&filtered, 10);
+
+    for (int i = 0; i < N; ++i)
+    {
+        judy_insert(&plain, keys + i * (K + 1), &plain);
+        judy_insert(&filtered, keys + i * (K + 1), &filtered);
+    }
+
+    uchar **queries = malloc(Q * sizeof(uchar *));
+
+    int ratios[] = {0, 70, 100};
+
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int i = 0; i < Q; ++i)
+        {
+            int idx = (int)((i * 2654435761u) % N);
+
+            queries[i] = (rand() % 100 < ratios[r] ? misses : keys) + idx * (K + 1);
+        }
+
+        size_t hits = 0;
+
+        double t0 = 1e9;
+        double t1 = 1e9;
+
+        // alternate the runs so both see the same machine state
+        for (int i = 0; i < RUNS; ++i)
+        {
+            t0 = _min(t0, _run(&plain, queries, &hits));
+            t1 = _min(t1, _run(&filtered, queries, &hits));
+        }
+
+        printf("%3d%% misses: plain %.0fns/lookup, filtered %.0fns/lookup (%.2fx), %zu hits\n",
+               ratios[r], t0, t1, t0 / t1, hits / (2 * RUNS));
+    }
+
+    judy_stats_t s0;
+    judy_stats_t s1;
+
+    judy_stats(&plain, &s0);
+    judy_stats(&filtered, &s1);
+
+    printf("filter: %.1f bytes/key\n", (double)(s1.bytes - s0.bytes) / N);
+
+    judy_delete(&plain);
+    judy_delete(&filtered);
+
+    free(queries);
+    free(misses);
+    free(keys);
+
+    return 0;
+}
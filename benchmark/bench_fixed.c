@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+#include "../src/judy.h"
+
+// 16 byte keys, e.g. uuids
+#define N 1000000
+#define K 16
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main()
+{
+    // the generic path needs a terminator, so the keys
+    // avoid '\0' in order to run on both paths
+    uchar *keys = malloc(N * (K + 1));
+
+    for (int i = 0; i < N; ++i)
+    {
+        uchar *key = keys + i * (K + 1);
+
+        for (int j = 0; j < K; ++j)
+            key[j] = (uchar)(rand() % 255 + 1);
+
+        key[K] = '\0';
+    }
+
+    judy_t generic;
+    judy_t fixed;
+
+    judy_create(&generic);
+    judy_create(&fixed);
+
+    for (int i = 0; i < N; ++i)
+    {
+        judy_insert(&generic, keys + i * (K + 1), &generic);
+        judy_insert16(&fixed, keys + i * (K + 1), &fixed);
+    }
+
+    // look the keys up in a different order than inserted
+    int *order = malloc(N * sizeof(int));
+
+    for (int i = 0; i < N; ++i)
+        order[i] = (int)((i * 2654435761u) % N);
+
+    size_t hits = 0;
+
+    double t0 = _now();
+
+    for (int i = 0; i < N; ++i)
+        hits += judy_lookup(&generic, keys + order[i] * (K + 1)) != NULL;
+
+    double t1 = _now();
+
+    for (int i = 0; i < N; ++i)
+        hits += judy_lookup16(&fixed, keys + order[i] * (K + 1)) != NULL;
+
+    double t2 = _now();
+
+    printf("generic: %.0fns/lookup\n", (t1 - t0) / N * 1e9);
+    printf("fixed:   %.0fns/lookup\n", (t2 - t1) / N * 1e9);
+    printf("hits:    %zu of %d\n", hits, 2 * N);
+
+    judy_delete(&generic);
+    judy_delete16(&fixed);
+
+    free(order);
+    free(keys);
+
+    return 0;
+}
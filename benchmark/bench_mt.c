@@ -0,0 +1,448 @@
+/**
+ * bench_mt: lookup and insert scalability with tail latencies.
+ *
+ * build it together with all translation units of src/, -lpthread and -lm.
+ *
+ *   bench_mt [-r READERS] [-w WRITERS] [-n KEYS] [-d DIST] [-t SECONDS]
+ *
+ *   -r  most reader threads, the runs double them from 1 (all cores)
+ *   -w  writer threads running alongside the readers (0)
+ *   -n  keys loaded before the runs (1000000)
+ *   -d  key distribution: uniform, zipf or seq (uniform)
+ *   -t  wall-clock seconds per run (1)
+ *
+ * Readers call judy_lookup on the loaded keys, writers call
+ * judy_insert on a key space twice as large, so half of their
+ * inserts add keys and half replace values. Judy arrays aren't
+ * safe for concurrent modification, so with writers all threads
+ * share a rwlock, which is part of what the runs measure.
+ *
+ * Every thread is pinned to a core of its own as far as there are
+ * cores and times each call into a log-linear histogram (5 bits of
+ * sub-buckets per power of two, i.e. within 3%), from which the
+ * percentiles are read after the run.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../src/judy.h"
+
+#define KEY_SIZE 24
+
+#define HIST_SUB 5
+#define HIST_BINS (64 << HIST_SUB)
+
+struct HIST
+{
+    uint64_t count;
+    uint64_t bins[HIST_BINS];
+};
+
+static int _hist_bin(uint64_t ns)
+{
+    if (ns < (1u << HIST_SUB))
+        return ns;
+
+    int exp = 63 - __builtin_clzll(ns);
+
+    // the HIST_SUB bits below the leading one
+    int sub = (ns >> (exp - HIST_SUB)) & ((1 << HIST_SUB) - 1);
+
+    return ((exp - HIST_SUB + 1) << HIST_SUB) + sub;
+}
+
+static uint64_t _hist_value(int bin)
+{
+    if (bin < (1 << HIST_SUB))
+        return bin;
+
+    int exp = (bin >> HIST_SUB) + HIST_SUB - 1;
+    uint64_t sub = bin & ((1 << HIST_SUB) - 1);
+
+    // the middle of the bin
+    return ((1ull << HIST_SUB | sub) << (exp - HIST_SUB)) + (1ull << (exp - HIST_SUB) >> 1);
+}
+
+static void _hist_add(struct HIST *hist, uint64_t ns)
+{
+    ++hist->bins[_hist_bin(ns)];
+    ++hist->count;
+}
+
+static void _hist_merge(struct HIST *to, const struct HIST *from)
+{
+    for (int i = 0; i < HIST_BINS; ++i)
+        to->bins[i] += from->bins[i];
+
+    to->count += from->count;
+}
+
+static uint64_t _hist_percentile(const struct HIST *hist, double p)
+{
+    uint64_t rank = (uint64_t)ceil(p / 100 * hist->count);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < HIST_BINS; ++i)
+    {
+        seen += hist->bins[i];
+
+        if (seen >= rank && seen)
+            return _hist_value(i);
+    }
+
+    return 0;
+}
+
+enum
+{
+    UNIFORM,
+    ZIPF,
+    SEQ,
+};
+
+/**
+ * zipfian indices with theta 0.99 as in YCSB (Gray et al., SIGMOD '94).
+ */
+struct ZIPF
+{
+    size_t n;
+    double theta;
+    double alpha;
+    double zeta;
+    double eta;
+};
+
+static void _zipf_init(struct ZIPF *zipf, size_t n)
+{
+    zipf->n = n;
+    zipf->theta = 0.99;
+    zipf->zeta = 0;
+
+    for (size_t i = 1; i <= n; ++i)
+        zipf->zeta += 1 / pow(i, zipf->theta);
+
+    double zeta2 = 1 + 1 / pow(2, zipf->theta);
+
+    zipf->alpha = 1 / (1 - zipf->theta);
+    zipf->eta = (1 - pow(2.0 / n, 1 - zipf->theta)) / (1 - zeta2 / zipf->zeta);
+}
+
+static size_t _zipf_next(const struct ZIPF *zipf, double u)
+{
+    double uz = u * zipf->zeta;
+
+    if (uz < 1)
+        return 0;
+
+    if (uz < 1 + pow(0.5, zipf->theta))
+        return 1;
+
+    size_t i = (size_t)(zipf->n * pow(zipf->eta * u - zipf->eta + 1, zipf->alpha));
+
+    return i < zipf->n ? i : zipf->n - 1;
+}
+
+struct BENCH
+{
+    judy_t judy;
+
+    // writers share the array with the readers through `lock`
+    bool locked;
+    pthread_rwlock_t lock;
+
+    uchar *keys;
+    size_t n;
+
+    int dist;
+    struct ZIPF zipf;
+
+    pthread_barrier_t start;
+    bool stop;
+};
+
+struct THREAD
+{
+    struct BENCH *bench;
+
+    bool writer;
+    int core;
+
+    uint64_t seed;
+    size_t pos;
+
+    struct HIST hist;
+
+    pthread_t thread;
+};
+
+static uchar *_key(struct BENCH *bench, size_t i)
+{
+    return bench->keys + i * KEY_SIZE;
+}
+
+static uint64_t _random(struct THREAD *thread)
+{
+    // xorshift64
+    uint64_t x = thread->seed;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return thread->seed = x;
+}
+
+/**
+ * the index of the next key below `n` in the chosen distribution.
+ */
+static size_t _next(struct THREAD *thread, size_t n)
+{
+    struct BENCH *bench = thread->bench;
+
+    switch (bench->dist)
+    {
+    case ZIPF:
+        // the hot indices are scattered over the key space
+        return _zipf_next(&bench->zipf, (_random(thread) >> 11) * 0x1.0p-53) * 2654435761u % n;
+    case SEQ:
+        return thread->pos++ % n;
+    default:
+        return _random(thread) % n;
+    }
+}
+
+static uint64_t _ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _pin(int core)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *_run(void *arg)
+{
+    struct THREAD *thread = arg;
+    struct BENCH *bench = thread->bench;
+
+    _pin(thread->core);
+
+    pthread_barrier_wait(&bench->start);
+
+    size_t sink = 0;
+
+    while (!__atomic_load_n(&bench->stop, __ATOMIC_RELAXED))
+    {
+        size_t i = _next(thread, thread->writer ? 2 * bench->n : bench->n);
+
+        uint64_t t0 = _ns();
+
+        if (thread->writer)
+        {
+            pthread_rwlock_wrlock(&bench->lock);
+            judy_insert(&bench->judy, _key(bench, i), &bench->judy);
+            pthread_rwlock_unlock(&bench->lock);
+        }
+        else if (bench->locked)
+        {
+            pthread_rwlock_rdlock(&bench->lock);
+            sink += judy_lookup(&bench->judy, _key(bench, i)) != NULL;
+            pthread_rwlock_unlock(&bench->lock);
+        }
+        else
+        {
+            sink += judy_lookup(&bench->judy, _key(bench, i)) != NULL;
+        }
+
+        _hist_add(&thread->hist, _ns() - t0);
+    }
+
+    // keeps the lookups from being optimized out
+    if (sink == (size_t)-1)
+        printf("\n");
+
+    return NULL;
+}
+
+static void _report(const char *name, const struct HIST *hist, int threads, double secs)
+{
+    printf("  %-7s %3d threads %8.2f Mops/s %7.2f Mops/s/thread   p50 %6lluns  p99 %6lluns  p99.9 %7lluns\n",
+           name, threads, hist->count / secs * 1e-6, hist->count / secs * 1e-6 / threads,
+           (unsigned long long)_hist_percentile(hist, 50),
+           (unsigned long long)_hist_percentile(hist, 99),
+           (unsigned long long)_hist_percentile(hist, 99.9));
+}
+
+/**
+ * runs `readers` and `writers` threads for `secs` seconds.
+ */
+static void _round(struct BENCH *bench, int readers, int writers, double secs)
+{
+    int n = readers + writers;
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    struct THREAD *threads = calloc(n, sizeof(struct THREAD));
+
+    pthread_barrier_init(&bench->start, NULL, n + 1);
+    bench->stop = false;
+
+    for (int i = 0; i < n; ++i)
+    {
+        threads[i].bench = bench;
+        threads[i].writer = i >= readers;
+        threads[i].core = i % cores;
+        threads[i].seed = 0x9e3779b97f4a7c15ull * (i + 1);
+        threads[i].pos = (size_t)i * bench->n / n;
+
+        pthread_create(&threads[i].thread, NULL, _run, &threads[i]);
+    }
+
+    pthread_barrier_wait(&bench->start);
+
+    double t0 = (double)_ns();
+
+    struct timespec ts = {(time_t)secs, (long)((secs - (time_t)secs) * 1e9)};
+
+    nanosleep(&ts, NULL);
+
+    __atomic_store_n(&bench->stop, true, __ATOMIC_RELAXED);
+
+    struct HIST *reads = calloc(1, sizeof(struct HIST));
+    struct HIST *writes = calloc(1, sizeof(struct HIST));
+
+    for (int i = 0; i < n; ++i)
+    {
+        pthread_join(threads[i].thread, NULL);
+
+        _hist_merge(threads[i].writer ? writes : reads, &threads[i].hist);
+    }
+
+    double elapsed = (_ns() - t0) * 1e-9;
+
+    printf("%d readers, %d writers, %.2fs\n", readers, writers, elapsed);
+
+    if (readers)
+        _report("lookup", reads, readers, elapsed);
+
+    if (writers)
+        _report("insert", writes, writers, elapsed);
+
+    pthread_barrier_destroy(&bench->start);
+
+    free(reads);
+    free(writes);
+    free(threads);
+}
+
+static void _usage(void)
+{
+    fprintf(stderr, "usage: bench_mt [-r READERS] [-w WRITERS] [-n KEYS] [-d uniform|zipf|seq] [-t SECONDS]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int readers = sysconf(_SC_NPROCESSORS_ONLN);
+    int writers = 0;
+    size_t n = 1000000;
+    double secs = 1;
+
+    struct BENCH *bench = calloc(1, sizeof(struct BENCH));
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:w:n:d:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            readers = atoi(optarg);
+            break;
+        case 'w':
+            writers = atoi(optarg);
+            break;
+        case 'n':
+            n = strtoull(optarg, NULL, 10);
+            break;
+        case 'd':
+            if (!strcmp(optarg, "zipf"))
+                bench->dist = ZIPF;
+            else if (!strcmp(optarg, "seq"))
+                bench->dist = SEQ;
+            else if (!strcmp(optarg, "uniform"))
+                bench->dist = UNIFORM;
+            else
+                _usage();
+            break;
+        case 't':
+            secs = atof(optarg);
+            break;
+        default:
+            _usage();
+        }
+    }
+
+    if (readers < 0 || writers < 0 || readers + writers == 0 || !n || secs <= 0)
+        _usage();
+
+    // the writers' key space holds the loaded keys and as many new ones
+    bench->n = n;
+    bench->keys = malloc(2 * n * KEY_SIZE);
+
+    for (size_t i = 0; i < 2 * n; ++i)
+        snprintf((char *)_key(bench, i), KEY_SIZE, "user:%016llx", (unsigned long long)(i * 0x9e3779b97f4a7c15ull));
+
+    if (bench->dist == ZIPF)
+        _zipf_init(&bench->zipf, 2 * n);
+
+    judy_create(&bench->judy);
+
+    for (size_t i = 0; i < n; ++i)
+        judy_insert(&bench->judy, _key(bench, i), &bench->judy);
+
+    bench->locked = writers > 0;
+    pthread_rwlock_init(&bench->lock, NULL);
+
+    // the keys inserted by the writers stay for the next
+    // rounds, which replace more values than they add
+    for (int r = 1;; r *= 2)
+    {
+        if (r > readers)
+            r = readers;
+
+        _round(bench, r, writers, secs);
+
+        if (r == readers)
+            break;
+    }
+
+    pthread_rwlock_destroy(&bench->lock);
+
+    judy_delete(&bench->judy);
+
+    free(bench->keys);
+    free(bench);
+
+    return 0;
+}
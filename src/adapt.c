@@ -0,0 +1,310 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Adaptive node selection:
+ *
+ * Sampled lookups count a hit for every node they pass above
+ * ADAPT_DEPTH in a small side table. A TINY node with ADAPT_HOT
+ * hits is promoted to a TRIE while the budget allows it.
+ * Every ADAPT_PERIOD samples all counts are halved and promoted
+ * nodes below ADAPT_COLD hits are demoted again. So are cold TRIE
+ * nodes built by inserts once removals left them with no more
+ * children than a TINY node holds. There is no node type between
+ * TINY and TRIE, so cold TRIE nodes with more children stay.
+ *
+ * The side table only holds hints. Entries may refer to nodes
+ * which have been replaced in the meantime, so a tracked node is
+ * always located again through its prefix before it is changed.
+ */
+
+#define ADAPT_BITS 10
+#define ADAPT_SLOTS (1 << ADAPT_BITS)
+#define ADAPT_PROBE 4
+#define ADAPT_DEPTH 16
+#define ADAPT_HOT 32
+#define ADAPT_COLD 4
+#define ADAPT_PERIOD 4096
+
+// extra bytes of a promoted node
+#define ADAPT_COST (sizeof(struct TRIE) - sizeof(struct TINY))
+
+struct HOT
+{
+    JP node;
+    uint32_t hits;
+
+    bool promoted;
+
+    uint8_t depth;
+    uchar prefix[ADAPT_DEPTH];
+};
+
+struct ADAPT
+{
+    size_t budget;
+    size_t spent;
+
+    uint32_t samples;
+
+    struct HOT hot[ADAPT_SLOTS];
+};
+
+void judy_adaptive(judy_t *judy, size_t budget)
+{
+    if (!judy->adapt)
+        judy->adapt = calloc(1, sizeof(struct ADAPT));
+
+    judy->adapt->budget = budget;
+}
+
+/**
+ * the entry tracking `node` or a free entry to track it.
+ * promoted nodes are never displaced. returns NULL if
+ * there is no room left.
+ */
+static struct HOT *_adapt_entry(struct ADAPT *adapt, JP node)
+{
+    uint64_t hash = (node >> 6) * 0x9e3779b97f4a7c15ull;
+    uint64_t base = hash >> (64 - ADAPT_BITS);
+
+    struct HOT *victim = NULL;
+
+    for (int i = 0; i < ADAPT_PROBE; ++i)
+    {
+        struct HOT *hot = &adapt->hot[(base + i) & (ADAPT_SLOTS - 1)];
+
+        if (hot->node == node)
+            return hot;
+
+        if (hot->promoted)
+            continue;
+
+        if (!victim || hot->hits < victim->hits)
+            victim = hot;
+    }
+
+    if (!victim)
+        return NULL;
+
+    // the displaced node has to earn its hits again
+    memset(victim, 0, sizeof(*victim));
+
+    victim->node = node;
+
+    return victim;
+}
+
+/**
+ * replaces the node in `slot` by a node of `type` with the same children.
+ */
+static JP _adapt_rebuild(JP *slot, int type)
+{
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    JP node = *slot;
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        nodes[i] = *slots[i];
+
+    *slot = _node_make(claim(_node_type_size(type)), type, keys, nodes, n);
+
+    stash((void *)decode(node), _node_size(node));
+
+    return *slot;
+}
+
+/**
+ * locates the slot of a tracked node again by its prefix.
+ */
+static JP *_adapt_locate(judy_t *judy, struct HOT *hot)
+{
+    JP *slot = &judy->root;
+
+    for (int i = 0; i < hot->depth; ++i)
+    {
+        slot = _node_find(*slot, hot->prefix[i]);
+
+        if (!slot || !*slot)
+            return NULL;
+    }
+
+    return *slot == hot->node ? slot : NULL;
+}
+
+/**
+ * halves all counts and demotes the promoted nodes and the
+ * sparse TRIE nodes which turned cold.
+ */
+static void _adapt_decay(judy_t *judy)
+{
+    struct ADAPT *adapt = judy->adapt;
+
+    for (int i = 0; i < ADAPT_SLOTS; ++i)
+    {
+        struct HOT *hot = &adapt->hot[i];
+
+        hot->hits >>= 1;
+
+        if (!hot->node || hot->hits >= ADAPT_COLD)
+            continue;
+
+        if (!hot->promoted && typeof(hot->node) != TRIE)
+            continue;
+
+        JP *slot = _adapt_locate(judy, hot);
+
+        // nodes which got replaced or filled up in the
+        // meantime are no longer charged to the budget
+        if (slot && _node_count(*slot) <= 7)
+        {
+            int64_t before = claimed();
+
+            _adapt_rebuild(slot, TINY);
+
+            COUNT(demotions);
+
+            if (judy->cache)
+                _cache_account(judy, before);
+
+            ++judy->version;
+
+            _stride_touch(judy, hot->prefix, hot->depth);
+
+            if (hot->depth == 2)
+                _table_update(judy, (uchar[]){hot->prefix[0], hot->prefix[1], '\0'});
+        }
+
+        if (hot->promoted)
+            adapt->spent -= ADAPT_COST;
+
+        memset(hot, 0, sizeof(*hot));
+    }
+}
+
+/**
+ * counts a hit for the node in `slot` of depth `depth` on the path of `key`.
+ */
+static void _adapt_hit(judy_t *judy, JP *slot, const uchar *key, int depth)
+{
+    struct ADAPT *adapt = judy->adapt;
+
+    struct HOT *hot = _adapt_entry(adapt, *slot);
+
+    if (!hot)
+        return;
+
+    // the prefix locates the node again for a demotion
+    if (!hot->hits)
+    {
+        hot->depth = depth;
+        memcpy(hot->prefix, key, depth);
+    }
+
+    if (++hot->hits < ADAPT_HOT || hot->promoted || typeof(*slot) != TINY)
+        return;
+
+    if (adapt->spent + ADAPT_COST > adapt->budget)
+        return;
+
+    int64_t before = claimed();
+
+    hot->node = _adapt_rebuild(slot, TRIE);
+
+    COUNT(promotions);
+
+    if (judy->cache)
+        _cache_account(judy, before);
+
+    hot->promoted = true;
+
+    // move the entry to where the new node hashes to
+    struct HOT *next = _adapt_entry(adapt, hot->node);
+
+    if (next && next != hot)
+    {
+        *next = *hot;
+        memset(hot, 0, sizeof(*hot));
+    }
+
+    adapt->spent += ADAPT_COST;
+
+    ++judy->version;
+
+    _stride_touch(judy, key, depth);
+
+    if (depth == 2)
+        _table_update(judy, key);
+}
+
+/**
+ * looks up `key` and counts a hit for every node on its path.
+ */
+static void *_adapt_walk(judy_t *judy, const uchar *key)
+{
+    JP *slot = &judy->root;
+
+    for (int depth = 0;; ++depth)
+    {
+        uchar cc = key[depth];
+
+        // a bucket resolves the rest of the key at once
+        if (typeof(*slot) == LEAF)
+        {
+            slot = _leaf_find(*slot, key + depth);
+
+            if (!slot)
+                return NULL;
+
+            break;
+        }
+
+        if (depth < ADAPT_DEPTH)
+            _adapt_hit(judy, slot, key, depth);
+
+        slot = _node_find(*slot, cc);
+
+        if (!slot || !*slot)
+            return NULL;
+
+        if (!cc)
+            break;
+    }
+
+    // sampled lookups bypass _cache_lookup but are references all the same
+    if (judy->cache && !(*slot & CACHE_REF))
+        *slot |= CACHE_REF;
+
+    return (void *)decode(*slot);
+}
+
+void *_adapt_lookup(judy_t *judy, const uchar *key)
+{
+    struct ADAPT *adapt = judy->adapt;
+
+    // promotions and demotions claim nodes
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    if (++adapt->samples % ADAPT_PERIOD == 0)
+        _adapt_decay(judy);
+
+    void *val = _adapt_walk(judy, key);
+
+    _heap_enter(heap);
+
+    return val;
+}
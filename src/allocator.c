@@ -1,130 +1,266 @@
+#include "internal.h"
+
+#include <stdio.h>
 #include <stdlib.h>
-#include <stdint.h>
+#include <string.h>
 
+#include <pthread.h>
 #include <sys/mman.h>
 
-#include <immintrin.h>
+/**
+ * Node pool:
+ *
+ * Nodes are carved from large chunks which are mapped from the os
+ * and never returned. Stashed nodes are kept on an intrusive free
+ * list per size class and handed out again by claim().
+ *
+ * Since every node is only ever returned to its size class,
+ * any 64 byte aligned block of the right size can be stashed,
+ * including blocks carved from an arena (see claim_arena()).
+ */
 
-#define B64 0x00000000ffffffffull
-#define B128 0x0000ffff00000000ull
-#define B256 0x00ff000000000000ull
-#define B512 0x0f00000000000000ull
-#define B1024 0x3000000000000000ull
-#define B2048 0x4000000000000000ull
+#define CHUNK_SIZE (1ull << 20)
 
-// we even have 1 bit left :)
+#define MAG_SIZE 64
+#define MAG_BATCH 32
 
-struct SLOT
+struct FREE
 {
+    struct FREE *next;
+};
 
-    // 1: used
-    // 0: free
-    union
-    {
-        struct 
-        {
-            uint32_t mask32lo;
-            uint32_t mask32hi;
-        };
-        uint64_t mask64;
-    };
-
-    uintptr_t base;
-    struct SLOT *next;
-} root;
+/**
+ * Every thread keeps a magazine of free nodes per size class.
+ * claim() and stash() only touch the magazines of the calling
+ * thread and move nodes from and to the shared pool in batches
+ * of MAG_BATCH, so the pool lock is taken once per batch.
+ */
+struct MAG
+{
+    int len;
+    void *nodes[MAG_SIZE];
+};
 
-void *alloc(size_t size)
+static struct POOL
 {
-    void *res = NULL;
+    pthread_mutex_t lock;
+
+    // unused rest of the current chunk
+    uchar *bump;
+    uchar *end;
 
+    struct FREE *free[CLASSES];
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int _pool_class(size_t size)
+{
     switch (size)
     {
     case 64:
-        return alloc64();
+        return N64;
+    case 128:
+        return N128;
+    case 256:
+        return N256;
+    case 2048:
+        return N2048;
+    default:
+        assert(0);
     }
 
-    return res;
+    __builtin_unreachable();
 }
 
-uint32_t pmask64(uint32_t i);
+static void *_pool_map(size_t size)
+{
+    int prot = PROT_READ | PROT_WRITE;
+    int flag = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    void *mem = mmap(NULL, size, prot, flag, -1, 0);
 
-void *alloc_64_from_slot(struct SLOT *slot)
+    if (mem == MAP_FAILED)
+    {
+        fprintf(stderr, "[error]: failed to mmap %zu bytes from os!\n", size);
+        exit(1);
+    }
+
+    return mem;
+}
+
+static void _pool_push(int cls, void *ptr)
 {
-    uint32_t msk = slot->mask32lo;
+    struct FREE *node = ptr;
 
-    if (~msk)
-        return NULL;
+    node->next = pool.free[cls];
+    pool.free[cls] = node;
+}
+
+/**
+ * carves `size` bytes from the current chunk.
+ * the rest of an exhausted chunk is kept as 64 byte nodes.
+ */
+static void *_pool_bump(size_t size)
+{
+    if (pool.bump + size > pool.end)
+    {
+        for (; pool.bump + 64 <= pool.end; pool.bump += 64)
+            _pool_push(N64, pool.bump);
+
+        pool.bump = _pool_map(CHUNK_SIZE);
+        pool.end = pool.bump + CHUNK_SIZE;
+    }
+
+    void *ptr = pool.bump;
+
+    pool.bump += size;
+
+    return ptr;
+}
+
+/**
+ * moves up to MAG_BATCH nodes of `cls` from the pool into `mag`.
+ */
+static void _mag_refill(struct MAG *mag, int cls, size_t size)
+{
+    pthread_mutex_lock(&pool.lock);
+
+    while (mag->len < MAG_BATCH)
+    {
+        struct FREE *node = pool.free[cls];
+
+        if (node)
+            pool.free[cls] = node->next;
+        else
+            node = _pool_bump(size);
+
+        mag->nodes[mag->len++] = node;
+    }
+
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * moves up to `count` nodes of `cls` from `mag` back into the pool.
+ */
+static void _mag_spill(struct MAG *mag, int cls, int count)
+{
+    pthread_mutex_lock(&pool.lock);
 
-    // 0..31
-    int idx = 31 - __builtin_clz(~msk);
+    while (count-- && mag->len)
+        _pool_push(cls, mag->nodes[--mag->len]);
 
-    slot->mask32hi |= pmask64(idx);
-    slot->mask32lo |= 1u << idx;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void _mag_flush(void *ptr)
+{
+    struct MAG *mags = ptr;
+
+    for (int cls = 0; cls < CLASSES; ++cls)
+        _mag_spill(&mags[cls], cls, MAG_SIZE);
+}
+
+static pthread_key_t mag_key;
+static pthread_once_t mag_once = PTHREAD_ONCE_INIT;
+
+static void _mag_key(void)
+{
+    pthread_key_create(&mag_key, _mag_flush);
+}
 
-    return (void *)(slot->base + 64 * idx);
+// bytes claimed minus bytes stashed by the calling thread
+static __thread int64_t balance;
+
+int64_t claimed(void)
+{
+    return balance;
 }
 
-// 0x0000000000000000000000000000000011111111111111111111111111111111
-// 0x0000000000000000000000000000000001010101010101010101010101010101
-// 0x0000000000000000111111111111111100000000000000000000000000000000
-//                   ^ 47            ^ 31                           ^ 0
-//
-
-uint32_t pmask64(uint32_t i)
-{
-    static const uint32_t T[16] = {
-        0x51010001,
-        0x51010002,
-        0x51020004,
-        0x51020008,
-        0x52040010,
-        0x52040020,
-        0x52080040,
-        0x52080080,
-        0x64100100,
-        0x64100200,
-        0x64200400,
-        0x64200800,
-        0x68401000,
-        0x68402000,
-        0x68804000,
-        0x68808000,
-    };
-
-    return T[i >> 1];
+/**
+ * the magazines of the calling thread.
+ * they are handed back to the pool when the thread exits.
+ */
+static struct MAG *_mag_local(int cls)
+{
+    static __thread struct MAG mags[CLASSES];
+    static __thread bool registered;
+
+    if (!registered)
+    {
+        pthread_once(&mag_once, _mag_key);
+        pthread_setspecific(mag_key, mags);
+
+        registered = true;
+    }
+
+    return &mags[cls];
 }
 
-uint64_t adj2(uint64_t x)
+// the persistent heap claim() and stash() currently use, if any
+static __thread struct HEAP *heap;
+
+struct HEAP *_heap_enter(struct HEAP *next)
 {
-    const uint64_t c1 = 0x5555555555555555ull;
-    const uint64_t c2 = 0xaaaaaaaaaaaaaaaaull;
+    struct HEAP *prev = heap;
 
-    return ((x & c1) << 1) & (x & c2);
+    heap = next;
+
+    return prev;
 }
 
-uint64_t adj4(uint64_t x)
+void *claim(size_t size)
 {
-    const uint64_t c1 = 0x3333333333333333ull;
-    const uint64_t c2 = 0xccccccccccccccccull;
+    int cls = _pool_class(size);
+
+    balance += size;
+
+    COUNT(claims[cls]);
+
+    if (heap)
+        return memset(_heap_claim(heap, cls, size), 0, size);
+
+    struct MAG *mag = _mag_local(cls);
 
-    return (adj2(x) << 4) & adj2(x);
+    if (!mag->len)
+        _mag_refill(mag, cls, size);
+
+    return memset(mag->nodes[--mag->len], 0, size);
 }
 
-uint32_t adj16x(uint32_t x) 
+void stash(void *ptr, size_t size)
 {
-    __m256i vx = _mm256_set1_epi32(x);
+    int cls = _pool_class(size);
+
+    balance -= size;
+
+    COUNT(stashes[cls]);
+
+    if (heap)
+    {
+        _heap_stash(heap, cls, ptr);
+        return;
+    }
 
-    __m256i c0 = _mm256_set_epi32(0xf, 0xe, 0xd, 0xc, 0xb, 0xa, 0x9, 0x8);
-    __m256i c1 = _mm256_set_epi32(0x7, 0x6, 0x5, 0x4, 0x3, 0x2, 0x1, 0x0);
+    struct MAG *mag = _mag_local(cls);
 
-    __m256i s0 = _mm256_sllv_epi32(vx, c0);
-    __m256i s1 = _mm256_sllv_epi32(vx, c1);
+    if (mag->len == MAG_SIZE)
+        _mag_spill(mag, cls, MAG_BATCH);
 
-    __m256i r0 = _mm256_and_si256(s0, s1);
-    __m256i r1 = _mm256_shuffle_epi32(r0, 0b10110001);
-    __m256i r2 = _mm256_and_si256(r0, r1);
-    __m256i r3 = _mm256_shuffle_epi32(r0, 0b01001110);
-    __m256i r4 = _mm256_and_si256(r2, r3);
+    mag->nodes[mag->len++] = ptr;
+}
 
-    return _mm256_extract_epi32(r4, 0) & _mm256_extract_epi32(r4, 1);
+void *claim_arena(size_t size)
+{
+    if (!size)
+        return NULL;
+
+    return _pool_map(size);
+}
+
+void release_arena(void *ptr, size_t size)
+{
+    if (ptr)
+        munmap(ptr, size);
 }
@@ -0,0 +1,299 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Batched insert:
+ *
+ * The batch is radix sorted most significant char first and
+ * inserted while sorting. Every bucket of a pass corresponds
+ * to one subexpanse of the node at the current depth, so the
+ * path down to a node is decoded once per batch and the node
+ * is grown to its final type at once.
+ */
+
+#define BATCH_SMALL 16
+
+// batches from this size on rebuild the whole root accelerator
+#define BATCH_REBUILD 16384
+
+struct BATCH
+{
+    judy_t *judy;
+
+    const uchar **keys;
+    void **vals;
+
+    // permutation of the batch and scratch space of the same size
+    size_t *idx;
+    size_t *tmp;
+};
+
+/**
+ * makes sure the node in `slot` has room for all chars in `chars`.
+ * an empty slot gets a node of the smallest fitting type.
+ */
+static void _batch_reserve(struct BATCH *batch, JP *slot, const uchar *chars, int n)
+{
+    if (!*slot)
+    {
+        int type = _node_type(n);
+
+        *slot = encode(claim(_node_type_size(type)), type);
+        return;
+    }
+
+    if (typeof(*slot) != TINY)
+        return;
+
+    int count = _node_count(*slot);
+
+    for (int i = 0; i < n && count <= 7; ++i)
+        if (!_tiny_find(*slot, chars[i]))
+            ++count;
+
+    if (count <= 7)
+        return;
+
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    JP node = *slot;
+
+    int m = _node_children(node, keys, slots);
+
+    for (int i = 0; i < m; ++i)
+        nodes[i] = *slots[i];
+
+    *slot = _node_make(claim(sizeof(struct TRIE)), TRIE, keys, nodes, m);
+
+    stash((void *)decode(node), _node_size(node));
+
+    COUNT(promotions);
+
+    ++batch->judy->version;
+}
+
+/**
+ * the slot of the node wrapped by the stride node in `slot` or `slot`.
+ * the batch goes through the wrapped node, see _batch_insert().
+ */
+static JP *_batch_base(JP *slot)
+{
+    if (typeof(*slot) != STRIDE)
+        return slot;
+
+    return &((struct STRIDE *)decode(*slot))->node;
+}
+
+/**
+ * inserts the keys `idx[lo..hi)` below `slot` which holds the node of `depth`.
+ */
+static void _batch_insert(struct BATCH *batch, JP *slot, size_t lo, size_t hi, int depth)
+{
+    const uchar **keys = batch->keys;
+    size_t *idx = batch->idx;
+
+    // small buckets are cheaper to insert one by one
+    // from here than to sort any further
+    if (hi - lo <= BATCH_SMALL)
+    {
+        for (size_t i = lo; i < hi; ++i)
+            _judy_insert(batch->judy, slot, keys[idx[i]], depth, batch->vals[idx[i]], NULL);
+
+        return;
+    }
+
+    // the bucket bursts so the batch can be sorted into its subexpanses
+    if (typeof(*slot) == LEAF && *slot)
+    {
+        _leaf_burst(slot);
+        ++batch->judy->version;
+    }
+
+    size_t count[257] = {};
+
+    for (size_t i = lo; i < hi; ++i)
+        ++count[keys[idx[i]][depth] + 1];
+
+    uchar chars[256];
+    int n = 0;
+
+    for (int c = 0; c < 256; ++c)
+    {
+        if (count[c + 1])
+            chars[n++] = c;
+
+        count[c + 1] += count[c];
+    }
+
+    // stable, so duplicate keys keep their order of the batch
+    for (size_t i = lo; i < hi; ++i)
+        batch->tmp[lo + count[keys[idx[i]][depth]]++] = idx[i];
+
+    memcpy(idx + lo, batch->tmp + lo, (hi - lo) * sizeof(size_t));
+
+    _batch_reserve(batch, _batch_base(slot), chars, n);
+
+    // the scatter left the end of every bucket in `count`
+    for (int i = 0; i < n; ++i)
+    {
+        uchar cc = chars[i];
+
+        size_t from = i ? lo + count[chars[i - 1]] : lo;
+        size_t to = lo + count[cc];
+
+        // inserts below may have wrapped or unwrapped the node meanwhile
+        JP *child = _batch_base(slot);
+
+        switch (typeof(*child))
+        {
+        case TINY:
+            _tiny_insert(&child, cc);
+            break;
+        case TRIE:
+            _trie_insert(&child, cc);
+            break;
+        }
+
+        // the last duplicate of the batch wins
+        if (!cc)
+            _judy_store(batch->judy, child, keys[idx[to - 1]], depth, batch->vals[idx[to - 1]]);
+        else
+            _batch_insert(batch, child, from, to, depth + 1);
+    }
+}
+
+/**
+ * the end of the run of keys in `idx[lo..hi)` which share the char of
+ * depth `depth` with the first one. the batch is sorted by it.
+ */
+static size_t _batch_run(struct BATCH *batch, size_t lo, size_t hi, int depth)
+{
+    uchar cc = batch->keys[batch->idx[lo]][depth];
+
+    size_t end = lo + 1;
+
+    while (end < hi && batch->keys[batch->idx[end]][depth] == cc)
+        ++end;
+
+    return end;
+}
+
+/**
+ * wraps the dense nodes which the keys `idx[lo..hi)` were sorted into
+ * below `slot` in stride nodes once the batch is in, top down like
+ * _stride_grow_all(). the tables of the stride nodes on the way are
+ * read again, since the batch went through their wrapped nodes.
+ */
+static void _batch_grow(struct BATCH *batch, JP *slot, size_t lo, size_t hi, int depth)
+{
+    const uchar **keys = batch->keys;
+    size_t *idx = batch->idx;
+
+    // the rest of the batch was inserted one by one
+    if (hi - lo <= BATCH_SMALL || typeof(*slot) == LEAF)
+        return;
+
+    if (_stride_grow(slot))
+        ++batch->judy->version;
+
+    JP node = *slot;
+
+    for (size_t from = lo, to; from < hi; from = to)
+    {
+        to = _batch_run(batch, from, hi, depth);
+
+        uchar cc = keys[idx[from]][depth];
+
+        if (!cc)
+            continue;
+
+        JP *child = _node_find(node, cc);
+
+        if (typeof(node) != STRIDE)
+        {
+            _batch_grow(batch, child, from, to, depth + 1);
+            continue;
+        }
+
+        // the nodes two levels below are mirrored by the table
+        if (to - from <= BATCH_SMALL || typeof(*child) == LEAF)
+            continue;
+
+        for (size_t at = from, end; at < to; at = end)
+        {
+            end = _batch_run(batch, at, to, depth + 1);
+
+            uchar next = keys[idx[at]][depth + 1];
+
+            if (next)
+                _batch_grow(batch, _node_find(*child, next), at, end, depth + 2);
+        }
+    }
+
+    if (typeof(node) == STRIDE)
+        _stride_refresh(node);
+}
+
+void judy_insert_batch(judy_t *judy, const uchar **keys, void **vals, size_t n)
+{
+    if (!n)
+        return;
+
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    struct BATCH batch = {
+        .judy = judy,
+        .keys = keys,
+        .vals = vals,
+        .idx = malloc(n * sizeof(size_t)),
+        .tmp = malloc(n * sizeof(size_t)),
+    };
+
+    for (size_t i = 0; i < n; ++i)
+        batch.idx[i] = i;
+
+    // the root accelerator is brought up to date
+    // once at the end instead of after every key
+    JP *table = judy->table;
+
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    int64_t before = claimed();
+
+    judy->table = NULL;
+
+    _batch_insert(&batch, &judy->root, 0, n, 0);
+    _batch_grow(&batch, &judy->root, 0, n, 0);
+
+    judy->table = table;
+
+    if (n >= BATCH_REBUILD)
+        _table_rebuild(judy);
+    else if (table)
+        for (size_t i = 0; i < n; ++i)
+            _table_update(judy, keys[i]);
+
+    free(batch.idx);
+    free(batch.tmp);
+
+    if (judy->cache)
+        _cache_settle(judy, before, NULL);
+
+    if (judy->filter)
+        _filter_settle(judy);
+
+    _heap_enter(heap);
+}
@@ -0,0 +1,238 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Cache mode:
+ *
+ * The bytes of all nodes are tracked through the claim() and
+ * stash() calls of every modification. Stores and lookups set
+ * CACHE_REF in the slot of the value they write or return.
+ *
+ * Eviction samples keys by a random descent from the root.
+ * A sampled key with CACHE_REF set gets a second chance and
+ * loses the bit (CLOCK), the first one without is evicted.
+ * If all CACHE_SAMPLES keys have been used the last one goes.
+ * The key just inserted is skipped, it would have to be looked
+ * up again right away.
+ */
+
+#define CACHE_SAMPLES 5
+
+struct CACHE
+{
+    size_t limit;
+
+    // bytes of all nodes of the judy array
+    int64_t bytes;
+
+    uint64_t seed;
+
+    judy_evict_t fn;
+    void *ctx;
+
+    // key of the current sample
+    uchar *key;
+    size_t cap;
+};
+
+void judy_cache(judy_t *judy, size_t limit, judy_evict_t fn, void *ctx)
+{
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    if (!judy->cache)
+    {
+        judy_stats_t stats;
+
+        judy_stats(judy, &stats);
+
+        judy->cache = calloc(1, sizeof(struct CACHE));
+
+        judy->cache->bytes = stats.bytes - (judy->table ? 65536 * sizeof(JP) : 0) - _filter_bytes(judy);
+        judy->cache->seed = 0x9e3779b97f4a7c15ull;
+    }
+
+    judy->cache->limit = limit;
+    judy->cache->fn = fn;
+    judy->cache->ctx = ctx;
+}
+
+void _cache_free(judy_t *judy)
+{
+    if (!judy->cache)
+        return;
+
+    free(judy->cache->key);
+    free(judy->cache);
+
+    judy->cache = NULL;
+}
+
+void *_cache_lookup(judy_t *judy, const uchar *key)
+{
+    JP *slot = &judy->root;
+
+    while (1)
+    {
+        if (typeof(*slot) == LEAF)
+        {
+            slot = _leaf_find(*slot, key);
+
+            if (!slot)
+                return NULL;
+
+            break;
+        }
+
+        uchar cc = *key++;
+
+        slot = _node_find(*slot, cc);
+
+        if (!slot || !*slot)
+            return NULL;
+
+        if (!cc)
+            break;
+    }
+
+    // only write if necessary to keep the cache line clean
+    if (!(*slot & CACHE_REF))
+        *slot |= CACHE_REF;
+
+    return (void *)decode(*slot);
+}
+
+void _cache_account(judy_t *judy, int64_t before)
+{
+    judy->cache->bytes += claimed() - before;
+}
+
+static uint64_t _cache_random(struct CACHE *cache)
+{
+    // xorshift64
+    uint64_t x = cache->seed;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    return cache->seed = x;
+}
+
+/**
+ * picks a random suffix of the bucket `node` and appends it to
+ * the key of the current sample at `depth`. returns its value slot.
+ */
+static JP *_cache_pick(struct CACHE *cache, JP node, size_t depth)
+{
+    struct LEAF *leaf = (struct LEAF *)decode(node);
+
+    int i = _cache_random(cache) % leaf->count;
+
+    uchar *suffix = _leaf_suffix(leaf, i, 0);
+    size_t len = strlen((char *)suffix) + 1;
+
+    if (depth + len > cache->cap)
+    {
+        cache->cap = 2 * (depth + len);
+        cache->key = realloc(cache->key, cache->cap);
+    }
+
+    memcpy(cache->key + depth, suffix, len);
+
+    return &_leaf_vals(leaf)[-i];
+}
+
+/**
+ * picks a key by choosing a random subexpanse on every level.
+ * the key is left in `cache->key`. returns its value slot.
+ */
+static JP *_cache_sample(judy_t *judy)
+{
+    struct CACHE *cache = judy->cache;
+
+    JP *slot = &judy->root;
+
+    for (size_t depth = 0;; ++depth)
+    {
+        if (typeof(*slot) == LEAF)
+            return _cache_pick(cache, *slot, depth);
+
+        int n = _node_count(*slot);
+
+        assert(n);
+
+        int pick = _cache_random(cache) % n;
+        int pos = 0;
+
+        uchar cc = 0;
+        JP *next;
+
+        do
+            next = _node_next(*slot, &pos, &cc);
+        while (pick--);
+
+        if (depth >= cache->cap)
+        {
+            cache->cap = cache->cap ? 2 * cache->cap : 64;
+            cache->key = realloc(cache->key, cache->cap);
+        }
+
+        cache->key[depth] = cc;
+
+        if (!cc)
+            return next;
+
+        slot = next;
+    }
+}
+
+void _cache_settle(judy_t *judy, int64_t before, const uchar *keep)
+{
+    struct CACHE *cache = judy->cache;
+
+    _cache_account(judy, before);
+
+    while (cache->bytes > (int64_t)cache->limit && judy->root)
+    {
+        JP *slot;
+        int skips = 0;
+
+        for (int i = 0; i < CACHE_SAMPLES; ++i)
+        {
+            slot = _cache_sample(judy);
+
+            if (keep && !strcmp((char *)cache->key, (char *)keep))
+            {
+                // the kept key is about all there is left
+                if (++skips > 4 * CACHE_SAMPLES)
+                    return;
+
+                --i;
+                continue;
+            }
+
+            if (!(*slot & CACHE_REF))
+                break;
+
+            *slot &= ~CACHE_REF;
+        }
+
+        void *val = (void *)decode(*slot);
+
+        judy_remove(judy, cache->key);
+
+        if (cache->fn)
+            cache->fn(cache->ctx, cache->key, val);
+    }
+}
@@ -0,0 +1,208 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * The levels above this depth are laid out breadth first.
+ * Every subtree below is laid out depth first so that a descent
+ * mostly walks forward through consecutive nodes of the arena.
+ */
+#define COMPACT_BFS_DEPTH 2
+
+struct STACK
+{
+    JP **items;
+    size_t len;
+    size_t cap;
+};
+
+static void _stack_push(struct STACK *stack, JP *slot)
+{
+    if (stack->len == stack->cap)
+    {
+        stack->cap = stack->cap ? 2 * stack->cap : 256;
+        stack->items = realloc(stack->items, stack->cap * sizeof(JP *));
+    }
+
+    stack->items[stack->len++] = slot;
+}
+
+/**
+ * pushes the slots of all child nodes of `node`.
+ * pushed in reverse order so that popping visits them in ascending order.
+ */
+static void _stack_children(struct STACK *stack, JP node)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = n - 1; i >= 0; --i)
+        if (keys[i])
+            _stack_push(stack, slots[i]);
+}
+
+/**
+ * appends the slots of all child nodes of `node` in ascending order.
+ */
+static void _queue_children(struct STACK *queue, JP node)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        if (keys[i])
+            _stack_push(queue, slots[i]);
+}
+
+/**
+ * size of the whole tree once every node is of its smallest type.
+ */
+static size_t _compact_size(JP root)
+{
+    struct STACK stack = {};
+
+    size_t size = 0;
+
+    _stack_push(&stack, &root);
+
+    while (stack.len)
+    {
+        JP node = *stack.items[--stack.len];
+
+        // buckets always have their smallest size
+        if (typeof(node) == LEAF)
+            size += _node_size(node);
+        else
+            size += _node_type_size(_node_type(_node_count(node)));
+
+        _stack_children(&stack, node);
+    }
+
+    free(stack.items);
+
+    return size;
+}
+
+/**
+ * rebuilds the node in `slot` at `*cursor` and stashes the original.
+ * the children are not moved yet.
+ */
+static void _compact_move(JP *slot, uchar **cursor)
+{
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    JP node = *slot;
+
+    if (typeof(node) == LEAF)
+    {
+        struct LEAF *leaf = (struct LEAF *)decode(node);
+
+        *slot = encode(_leaf_copy(*cursor, leaf, leaf->lines), LEAF);
+        *cursor += _leaf_size(leaf);
+
+        stash(leaf, _leaf_size(leaf));
+
+        return;
+    }
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        nodes[i] = *slots[i];
+
+    int type = _node_type(n);
+
+    void *mem = *cursor;
+    *cursor += _node_type_size(type);
+
+    *slot = _node_make(mem, type, keys, nodes, n);
+
+    stash((void *)decode(node), _node_size(node));
+}
+
+void judy_compact(judy_t *judy)
+{
+    // the arena can't be carved from the file of a persistent array
+    // and a frozen array is packed already
+    if (!judy->root || judy->heap || judy->frozen)
+        return;
+
+    int64_t before = claimed();
+
+    // stride nodes are claimed on their own and rebuilt afterwards
+    _stride_strip(&judy->root);
+
+    size_t size = _compact_size(judy->root);
+
+    uchar *cursor = claim_arena(size);
+
+    struct STACK level = {};
+    struct STACK next = {};
+
+    _compact_move(&judy->root, &cursor);
+    _stack_push(&level, &judy->root);
+
+    for (int depth = 0; depth < COMPACT_BFS_DEPTH; ++depth)
+    {
+        next.len = 0;
+
+        for (size_t i = 0; i < level.len; ++i)
+        {
+            size_t from = next.len;
+
+            _queue_children(&next, *level.items[i]);
+
+            for (size_t j = from; j < next.len; ++j)
+                _compact_move(next.items[j], &cursor);
+        }
+
+        struct STACK tmp = level;
+        level = next;
+        next = tmp;
+    }
+
+    // the remaining subtrees one after another in preorder
+    for (size_t i = 0; i < level.len; ++i)
+    {
+        next.len = 0;
+
+        _stack_children(&next, *level.items[i]);
+
+        while (next.len)
+        {
+            JP *slot = next.items[--next.len];
+
+            _compact_move(slot, &cursor);
+            _stack_children(&next, *slot);
+        }
+    }
+
+    free(level.items);
+    free(next.items);
+
+    _stride_grow_all(&judy->root);
+
+    // the original nodes went back to the pool,
+    // the arena now holds all nodes of the tree
+    if (judy->cache)
+        _cache_account(judy, before - size);
+
+    // every slot has moved
+    ++judy->version;
+
+    _table_rebuild(judy);
+}
@@ -0,0 +1,138 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <string.h>
+
+#ifdef JUDY_COUNTERS
+
+#include <stdlib.h>
+#include <pthread.h>
+
+/**
+ * Instrumentation:
+ *
+ * Every thread counts into its own block which is linked into a
+ * registry on first use, so counting never synchronizes threads.
+ * The counters of an exiting thread are folded into `retired`.
+ */
+
+struct BLOCK
+{
+    judy_counters_t counters;
+
+    struct BLOCK *next;
+};
+
+static struct REGISTRY
+{
+    pthread_mutex_t lock;
+
+    struct BLOCK *blocks;
+
+    judy_counters_t retired;
+} registry = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread struct BLOCK *local;
+
+static pthread_key_t block_key;
+static pthread_once_t block_once = PTHREAD_ONCE_INIT;
+
+#define FIELDS (sizeof(judy_counters_t) / sizeof(uint64_t))
+
+static void _counters_add(judy_counters_t *sum, const judy_counters_t *counters)
+{
+    uint64_t *dst = (uint64_t *)sum;
+    const uint64_t *src = (const uint64_t *)counters;
+
+    for (size_t i = 0; i < FIELDS; ++i)
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+static void _counters_retire(void *ptr)
+{
+    struct BLOCK *block = ptr;
+
+    pthread_mutex_lock(&registry.lock);
+
+    struct BLOCK **link = &registry.blocks;
+
+    while (*link != block)
+        link = &(*link)->next;
+
+    *link = block->next;
+
+    _counters_add(&registry.retired, &block->counters);
+
+    pthread_mutex_unlock(&registry.lock);
+
+    free(block);
+}
+
+static void _counters_key(void)
+{
+    pthread_key_create(&block_key, _counters_retire);
+}
+
+judy_counters_t *_counters_local(void)
+{
+    if (__builtin_expect(local != NULL, 1))
+        return &local->counters;
+
+    local = calloc(1, sizeof(struct BLOCK));
+
+    pthread_once(&block_once, _counters_key);
+    pthread_setspecific(block_key, local);
+
+    pthread_mutex_lock(&registry.lock);
+
+    local->next = registry.blocks;
+    registry.blocks = local;
+
+    pthread_mutex_unlock(&registry.lock);
+
+    return &local->counters;
+}
+
+void judy_counters_get(judy_counters_t *counters)
+{
+    pthread_mutex_lock(&registry.lock);
+
+    *counters = registry.retired;
+
+    for (struct BLOCK *block = registry.blocks; block; block = block->next)
+        _counters_add(counters, &block->counters);
+
+    pthread_mutex_unlock(&registry.lock);
+}
+
+void judy_counters_reset(void)
+{
+    pthread_mutex_lock(&registry.lock);
+
+    memset(&registry.retired, 0, sizeof(judy_counters_t));
+
+    for (struct BLOCK *block = registry.blocks; block; block = block->next)
+    {
+        uint64_t *fields = (uint64_t *)&block->counters;
+
+        for (size_t i = 0; i < FIELDS; ++i)
+            __atomic_store_n(&fields[i], 0, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&registry.lock);
+}
+
+#else
+
+void judy_counters_get(judy_counters_t *counters)
+{
+    memset(counters, 0, sizeof(*counters));
+}
+
+void judy_counters_reset(void)
+{
+}
+
+#endif
@@ -0,0 +1,218 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Negative lookup filter:
+ *
+ * A blocked Bloom filter over all keys sits in front of the root.
+ * The hash of a key picks one block of FILTER_BLOCK bits, a single
+ * cache line, and sets `k` bits within it by double hashing. So a
+ * lookup of a missing key is mostly rejected after one cache line
+ * without touching any node, while a hit pays that line on top.
+ *
+ * Bits can't be cleared, removed keys only leave stale bits which
+ * raise the false positive rate. Once the filter holds more keys
+ * than it was sized for or a quarter of them has been removed, the
+ * next modification rebuilds it from the keys of the tree.
+ */
+
+#define FILTER_BLOCK 512
+#define FILTER_WORDS (FILTER_BLOCK / 64)
+#define FILTER_MIN 16
+#define FILTER_K 16
+
+struct FILTER
+{
+    // bits per key and bits set per key
+    int bits;
+    int k;
+
+    size_t mask;
+    uint64_t *words;
+
+    // keys the filter was sized for
+    size_t capacity;
+
+    // keys added since the filter was built, including replaced ones
+    size_t keys;
+    size_t removed;
+};
+
+static uint64_t _filter_hash(const uchar *key, size_t len)
+{
+    uint64_t h = len * 0x9e3779b97f4a7c15ull;
+    uint64_t w;
+
+    for (; len >= 8; key += 8, len -= 8)
+    {
+        memcpy(&w, key, 8);
+
+        h = (h ^ w) * 0x9fb21c651e98df25ull;
+        h ^= h >> 29;
+    }
+
+    if (len)
+    {
+        w = 0;
+        memcpy(&w, key, len);
+
+        h = (h ^ w) * 0x9fb21c651e98df25ull;
+    }
+
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**
+ * the high half of the hash picks the block and
+ * the low half yields the bit offsets within it.
+ */
+static uint64_t *_filter_block(struct FILTER *filter, uint64_t hash)
+{
+    return &filter->words[((hash >> 32) & filter->mask) * FILTER_WORDS];
+}
+
+static void _filter_set(struct FILTER *filter, uint64_t hash)
+{
+    uint64_t *block = _filter_block(filter, hash);
+
+    uint32_t bit = (uint32_t)hash;
+    uint32_t step = (uint32_t)(hash >> 9) | 1;
+
+    for (int i = 0; i < filter->k; ++i, bit += step)
+        block[(bit >> 6) % FILTER_WORDS] |= 1ull << (bit & 63);
+}
+
+bool _filter_test(judy_t *judy, const uchar *key)
+{
+    struct FILTER *filter = judy->filter;
+
+    uint64_t hash = _filter_hash(key, strlen((const char *)key));
+    uint64_t *block = _filter_block(filter, hash);
+
+    uint32_t bit = (uint32_t)hash;
+    uint32_t step = (uint32_t)(hash >> 9) | 1;
+
+    uint64_t all = 1;
+
+    // one branch for all bits instead of one per bit
+    for (int i = 0; i < filter->k; ++i, bit += step)
+        all &= block[(bit >> 6) % FILTER_WORDS] >> (bit & 63);
+
+    return all;
+}
+
+void _filter_add(judy_t *judy, const uchar *key)
+{
+    struct FILTER *filter = judy->filter;
+
+    _filter_set(filter, _filter_hash(key, strlen((const char *)key)));
+
+    ++filter->keys;
+}
+
+void _filter_remove(judy_t *judy)
+{
+    ++judy->filter->removed;
+}
+
+static void _filter_visit(void *ctx, int tid, const uchar *key, size_t len, void *val)
+{
+    struct FILTER *filter = ctx;
+
+    (void)tid;
+    (void)val;
+
+    _filter_set(filter, _filter_hash(key, len));
+
+    ++filter->keys;
+}
+
+/**
+ * sizes the filter for at least `keys` keys and sets the bits of the tree.
+ */
+static void _filter_build(judy_t *judy, size_t keys)
+{
+    struct FILTER *filter = judy->filter;
+
+    size_t blocks = FILTER_MIN;
+
+    while (blocks * FILTER_BLOCK < keys * filter->bits)
+        blocks *= 2;
+
+    free(filter->words);
+
+    filter->words = aligned_alloc(64, blocks * FILTER_BLOCK / 8);
+    memset(filter->words, 0, blocks * FILTER_BLOCK / 8);
+
+    filter->mask = blocks - 1;
+    filter->capacity = blocks * FILTER_BLOCK / filter->bits;
+    filter->keys = 0;
+    filter->removed = 0;
+
+    judy_parallel_foreach(judy, _filter_visit, filter, 1);
+}
+
+void _filter_rebuild(judy_t *judy)
+{
+    struct FILTER *filter = judy->filter;
+
+    _filter_build(judy, filter->keys > filter->removed ? filter->keys - filter->removed : 0);
+}
+
+void _filter_settle(judy_t *judy)
+{
+    struct FILTER *filter = judy->filter;
+
+    if (filter->keys > filter->capacity || 4 * filter->removed > filter->keys)
+        _filter_rebuild(judy);
+}
+
+void judy_filter(judy_t *judy, int bits)
+{
+    if (bits < 1)
+        bits = 1;
+
+    if (!judy->filter)
+        judy->filter = calloc(1, sizeof(struct FILTER));
+
+    judy_stats_t stats;
+
+    judy_stats(judy, &stats);
+
+    // k = bits * ln(2) minimizes the false positive rate
+    judy->filter->bits = bits;
+    judy->filter->k = (bits * 177 + 128) / 256;
+
+    if (judy->filter->k < 1)
+        judy->filter->k = 1;
+    else if (judy->filter->k > FILTER_K)
+        judy->filter->k = FILTER_K;
+
+    _filter_build(judy, stats.keys);
+}
+
+size_t _filter_bytes(judy_t *judy)
+{
+    if (!judy->filter)
+        return 0;
+
+    return (judy->filter->mask + 1) * FILTER_BLOCK / 8;
+}
+
+void _filter_free(judy_t *judy)
+{
+    if (!judy->filter)
+        return;
+
+    free(judy->filter->words);
+    free(judy->filter);
+
+    judy->filter = NULL;
+}
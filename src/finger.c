@@ -0,0 +1,172 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+
+void judy_finger_init(judy_finger_t *finger, judy_t *judy)
+{
+    finger->judy = judy;
+    finger->version = judy->version;
+    finger->depth = 0;
+    finger->path[0] = &judy->root;
+}
+
+/**
+ * returns the depth of the deepest cached node on the path of `key`.
+ * a finger recorded before any node got replaced starts over at the root.
+ */
+static int _finger_resume(judy_finger_t *finger, const uchar *key)
+{
+    judy_t *judy = finger->judy;
+
+    if (finger->version != judy->version)
+    {
+        judy_finger_init(finger, judy);
+        return 0;
+    }
+
+    int depth = 0;
+
+    while (depth < finger->depth && key[depth] == finger->key[depth])
+        ++depth;
+
+    // the slots below a stride node aren't cached, see _judy_insert()
+    while (!finger->path[depth])
+        --depth;
+
+    return depth;
+}
+
+/**
+ * caches the chars of `key` which lead to the node of `depth`.
+ * the chars before `from` are still cached from the previous key.
+ */
+static void _finger_record(judy_finger_t *finger, const uchar *key, int from, int depth)
+{
+    if (depth > JUDY_FINGER_DEPTH)
+        depth = JUDY_FINGER_DEPTH;
+
+    if (depth > from)
+        memcpy(finger->key + from, key + from, depth - from);
+
+    finger->depth = depth;
+}
+
+void *judy_lookup_finger(judy_finger_t *finger, const uchar *key)
+{
+    int from = _finger_resume(finger, key);
+    int depth = from;
+
+    JP *slot = finger->path[depth];
+
+    void *val = NULL;
+
+    // the deepest depth below a stride node
+    int shadow = -1;
+
+    while (1)
+    {
+        uchar cc = key[depth];
+        JP node = *slot;
+
+        JP *next;
+
+        // a bucket resolves the rest of the key at once
+        if (typeof(node) == LEAF)
+        {
+            next = _leaf_find(node, key + depth);
+
+            if (next)
+            {
+                if (finger->judy->cache && !(*next & CACHE_REF))
+                    *next |= CACHE_REF;
+
+                val = (void *)decode(*next);
+            }
+
+            break;
+        }
+
+        // fingers decode one char at a time. the table of a mutable
+        // stride node would go stale if an insert resumed below it
+        if (typeof(node) == STRIDE)
+        {
+            if (((struct STRIDE *)decode(node))->claimed)
+                shadow = depth + 2;
+
+            node = _stride_base(node);
+        }
+
+        switch (typeof(node))
+        {
+        case TINY:
+            next = _tiny_find(node, cc);
+            break;
+        case TRIE:
+            next = _trie_find(node, cc);
+            break;
+        case PACKED:
+            next = _packed_find(node, cc);
+            break;
+        default:
+            assert(0);
+        }
+
+        if (!next || !*next)
+            break;
+
+        if (!cc)
+        {
+            if (finger->judy->cache && !(*next & CACHE_REF))
+                *next |= CACHE_REF;
+
+            val = (void *)decode(*next);
+            break;
+        }
+
+        slot = next;
+
+        if (++depth <= JUDY_FINGER_DEPTH)
+            finger->path[depth] = depth <= shadow ? NULL : slot;
+    }
+
+    _finger_record(finger, key, from, depth);
+
+    return val;
+}
+
+void judy_insert_finger(judy_finger_t *finger, const uchar *key, void *val)
+{
+    judy_t *judy = finger->judy;
+
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    int64_t before = claimed();
+
+    int from = _finger_resume(finger, key);
+    int depth = _judy_insert(judy, finger->path[from], key, from, val, finger->path);
+
+    // a promotion during this insert only replaced nodes
+    // below `from` whose slots have just been recorded again
+    finger->version = judy->version;
+
+    _finger_record(finger, key, from, depth);
+
+    // evictions change the version once more and reset the finger
+    if (judy->cache)
+        _cache_settle(judy, before, key);
+
+    if (judy->filter)
+        _filter_settle(judy);
+
+    _heap_enter(heap);
+}
@@ -0,0 +1,145 @@
+#include "judy.h"
+#include "internal.h"
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Fixed-length keys:
+ *
+ * All keys of the judy array are exactly K bytes long and may
+ * contain '\0'. There is no terminator, the slot of the last byte
+ * at depth K - 1 holds the value directly. Leaf buckets store the
+ * suffixes of the remaining K - depth bytes without a terminator.
+ *
+ * The lookups are generated for every K so the descent is fully
+ * unrolled and no step has to test for the end of the key.
+ */
+
+static void _fixed_insert(judy_t *judy, const uchar *key, int len, void *val)
+{
+    JP *nodeptr = &judy->root;
+
+    for (int depth = 0; depth < len;)
+    {
+        JP *slot = nodeptr;
+        JP type = typeof(*slot);
+
+        if (type == LEAF)
+        {
+            if (_leaf_insert_n(&nodeptr, key + depth, len - depth))
+                break;
+
+            if (*slot)
+            {
+                _leaf_burst_n(slot, len - depth);
+                ++judy->version;
+            }
+            else
+            {
+                *slot = encode(claim(sizeof(struct TINY)), TINY);
+            }
+
+            continue;
+        }
+
+        switch (type)
+        {
+        case TINY:
+            _tiny_insert(&nodeptr, key[depth]);
+            break;
+        case TRIE:
+            _trie_insert(&nodeptr, key[depth]);
+            break;
+        }
+
+        if (typeof(*slot) != type)
+            ++judy->version;
+
+        ++depth;
+    }
+
+    *nodeptr = encode(val, LEAF);
+}
+
+/**
+ * stashes `node` and all nodes and buckets below it down
+ * to the values `height` levels below, which are kept.
+ */
+static void _fixed_release(JP node, int height)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    if (!node)
+        return;
+
+    if (height > 1)
+    {
+        int n = _node_children(node, keys, slots);
+
+        for (int i = 0; i < n; ++i)
+            _fixed_release(*slots[i], height - 1);
+    }
+
+    stash((void *)decode(node), _node_size(node));
+}
+
+#define FIXED(K)                                                        \
+    void *judy_lookup##K(judy_t *judy, const uchar *key)                \
+    {                                                                   \
+        JP node = judy->root;                                           \
+        bool res;                                                       \
+                                                                        \
+        _Pragma("GCC unroll 32") for (int depth = 0; depth < K; ++depth) \
+        {                                                               \
+            switch (typeof(node))                                       \
+            {                                                           \
+            case LEAF:                                                  \
+            {                                                           \
+                /* a bucket resolves the rest of the key at once */     \
+                JP *val = _leaf_find_n(node, key + depth, K - depth);   \
+                return val ? (void *)decode(*val) : NULL;               \
+            }                                                           \
+            case TINY:                                                  \
+                res = _tiny_lookup(&node, key[depth]);                  \
+                break;                                                  \
+            default:                                                    \
+                res = _trie_lookup(&node, key[depth]);                  \
+                break;                                                  \
+            }                                                           \
+                                                                        \
+            if (!res)                                                   \
+                return NULL;                                            \
+        }                                                               \
+                                                                        \
+        return (void *)decode(node);                                    \
+    }                                                                   \
+                                                                        \
+    void judy_insert##K(judy_t *judy, const uchar *key, void *val)      \
+    {                                                                   \
+        struct HEAP *heap = _heap_enter(judy->heap);                    \
+                                                                        \
+        _fixed_insert(judy, key, K, val);                               \
+                                                                        \
+        _heap_enter(heap);                                              \
+    }                                                                   \
+                                                                        \
+    void judy_delete##K(judy_t *judy)                                   \
+    {                                                                   \
+        if (!judy->heap)                                                \
+        {                                                               \
+            _fixed_release(judy->root, K);                              \
+            judy->root = (JP)0;                                         \
+        }                                                               \
+                                                                        \
+        judy_delete(judy);                                              \
+    }
+
+FIXED(8)
+FIXED(16)
+FIXED(32)
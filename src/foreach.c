@@ -0,0 +1,304 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sched.h>
+#include <pthread.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Parallel traversal:
+ *
+ * A task is a subtree together with the chars leading to it.
+ * Every worker walks its tasks depth first. Above FOREACH_DEPTH
+ * a worker with less than FOREACH_LOW queued tasks hands the
+ * children of the current node out as new tasks instead of
+ * walking them itself, so there is always work to steal while
+ * deep or skewed subtrees are never split up.
+ *
+ * Workers pop their own tasks from the back of their deque
+ * and steal from the front of the deques of other workers.
+ */
+
+#define FOREACH_DEPTH 32
+#define FOREACH_LOW 4
+
+struct TASK
+{
+    JP node;
+    int depth;
+    uchar prefix[FOREACH_DEPTH];
+};
+
+struct DEQUE
+{
+    pthread_mutex_t lock;
+
+    struct TASK *tasks;
+    size_t head;
+    size_t tail;
+    size_t cap;
+};
+
+struct WORKER
+{
+    struct FOREACH *foreach;
+    int tid;
+
+    struct DEQUE deque;
+
+    // chars of the key currently visited
+    uchar *key;
+    size_t cap;
+
+    pthread_t thread;
+};
+
+struct FOREACH
+{
+    judy_visit_t fn;
+    void *ctx;
+
+    int nthreads;
+    struct WORKER *workers;
+
+    // tasks which have been queued but not finished yet
+    size_t pending;
+};
+
+static void _deque_push(struct DEQUE *deque, struct TASK *task)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->tail == deque->cap)
+    {
+        size_t len = deque->tail - deque->head;
+
+        // grow unless sliding out the stolen front makes enough room
+        if (len >= deque->cap / 2)
+        {
+            deque->cap = deque->cap ? 2 * deque->cap : 64;
+            deque->tasks = realloc(deque->tasks, deque->cap * sizeof(struct TASK));
+        }
+
+        memmove(deque->tasks, deque->tasks + deque->head, len * sizeof(struct TASK));
+
+        deque->head = 0;
+        deque->tail = len;
+    }
+
+    deque->tasks[deque->tail++] = *task;
+
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/**
+ * takes a task from the back (own deque) or the front (stealing).
+ */
+static bool _deque_pop(struct DEQUE *deque, struct TASK *task, bool steal)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    bool res = deque->head != deque->tail;
+
+    if (res)
+        *task = steal ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return res;
+}
+
+static size_t _deque_size(struct DEQUE *deque)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    size_t len = deque->tail - deque->head;
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return len;
+}
+
+static void _worker_task(struct WORKER *worker, JP node, const uchar *prefix, int depth)
+{
+    struct TASK task = {.node = node, .depth = depth};
+
+    if (depth)
+        memcpy(task.prefix, prefix, depth);
+
+    __atomic_add_fetch(&worker->foreach->pending, 1, __ATOMIC_RELAXED);
+
+    _deque_push(&worker->deque, &task);
+}
+
+/**
+ * visits all keys of the bucket `node` whose first `depth` chars are in `worker->key`.
+ */
+static void _worker_leaf(struct WORKER *worker, JP node, size_t depth)
+{
+    struct FOREACH *foreach = worker->foreach;
+    struct LEAF *leaf = (struct LEAF *)decode(node);
+
+    uchar *suffix = leaf->data;
+
+    for (int i = 0; i < leaf->count; ++i)
+    {
+        size_t len = strlen((char *)suffix) + 1;
+
+        if (depth + len > worker->cap)
+        {
+            worker->cap = 2 * (depth + len);
+            worker->key = realloc(worker->key, worker->cap);
+        }
+
+        memcpy(worker->key + depth, suffix, len);
+
+        foreach->fn(foreach->ctx, worker->tid, worker->key, depth + len - 1, (void *)decode(_leaf_vals(leaf)[-i]));
+
+        suffix += len;
+    }
+}
+
+/**
+ * visits all keys below `node` whose first `depth` chars are in `worker->key`.
+ */
+static void _worker_visit(struct WORKER *worker, JP node, size_t depth)
+{
+    struct FOREACH *foreach = worker->foreach;
+
+    if (depth + 1 >= worker->cap)
+    {
+        worker->cap = 2 * (depth + 1);
+        worker->key = realloc(worker->key, worker->cap);
+    }
+
+    if (typeof(node) == LEAF)
+    {
+        _worker_leaf(worker, node, depth);
+        return;
+    }
+
+    bool split = depth < FOREACH_DEPTH && _deque_size(&worker->deque) < FOREACH_LOW;
+
+    int pos = 0;
+    uchar cc;
+
+    for (JP *slot; (slot = _node_next(node, &pos, &cc));)
+    {
+        worker->key[depth] = cc;
+
+        if (!cc)
+        {
+            foreach->fn(foreach->ctx, worker->tid, worker->key, depth, (void *)decode(*slot));
+        }
+        else if (split)
+        {
+            _worker_task(worker, *slot, worker->key, depth + 1);
+        }
+        else
+        {
+            _worker_visit(worker, *slot, depth + 1);
+        }
+    }
+}
+
+static void *_worker_run(void *arg)
+{
+    struct WORKER *worker = arg;
+    struct FOREACH *foreach = worker->foreach;
+
+    int n = foreach->nthreads;
+
+    struct TASK task;
+
+    while (1)
+    {
+        bool found = _deque_pop(&worker->deque, &task, false);
+
+        for (int i = 1; i < n && !found; ++i)
+            found = _deque_pop(&foreach->workers[(worker->tid + i) % n].deque, &task, true);
+
+        if (!found)
+        {
+            if (!__atomic_load_n(&foreach->pending, __ATOMIC_ACQUIRE))
+                break;
+
+            sched_yield();
+            continue;
+        }
+
+        memcpy(worker->key, task.prefix, task.depth);
+
+        _worker_visit(worker, task.node, task.depth);
+
+        __atomic_sub_fetch(&foreach->pending, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+void judy_parallel_reduce(judy_t *judy, judy_visit_t fn, judy_reduce_t reduce, void *ctx, int nthreads)
+{
+    if (nthreads < 1)
+        nthreads = 1;
+
+    struct FOREACH foreach = {
+        .fn = fn,
+        .ctx = ctx,
+        .nthreads = nthreads,
+        .workers = calloc(nthreads, sizeof(struct WORKER)),
+    };
+
+    for (int i = 0; i < nthreads; ++i)
+    {
+        struct WORKER *worker = &foreach.workers[i];
+
+        worker->foreach = &foreach;
+        worker->tid = i;
+        worker->cap = FOREACH_DEPTH + 1;
+        worker->key = malloc(worker->cap);
+
+        pthread_mutex_init(&worker->deque.lock, NULL);
+    }
+
+    if (judy->root)
+        _worker_task(&foreach.workers[0], judy->root, NULL, 0);
+
+    // the calling thread is worker 0
+    for (int i = 1; i < nthreads; ++i)
+        pthread_create(&foreach.workers[i].thread, NULL, _worker_run, &foreach.workers[i]);
+
+    _worker_run(&foreach.workers[0]);
+
+    for (int i = 1; i < nthreads; ++i)
+        pthread_join(foreach.workers[i].thread, NULL);
+
+    for (int i = 0; i < nthreads; ++i)
+    {
+        struct WORKER *worker = &foreach.workers[i];
+
+        if (reduce)
+            reduce(ctx, i);
+
+        pthread_mutex_destroy(&worker->deque.lock);
+
+        free(worker->deque.tasks);
+        free(worker->key);
+    }
+
+    free(foreach.workers);
+}
+
+void judy_parallel_foreach(judy_t *judy, judy_visit_t fn, void *ctx, int nthreads)
+{
+    judy_parallel_reduce(judy, fn, NULL, ctx, nthreads);
+}
@@ -0,0 +1,664 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Frozen arrays:
+ *
+ * judy_freeze moves all nodes into a single arena and cuts each
+ * one down to its population. Nodes of up to 7 subexpanses stay
+ * TINY nodes whose unused slots at the end are left out, larger
+ * ones become PACKED nodes with a bitmap and a dense array. Leaf
+ * buckets are copied unchanged into a 64 byte aligned region after
+ * the inner nodes. The nodes are laid out in preorder.
+ *
+ * Cut TINY nodes can't take any more slots, so the array is never
+ * modified in place. Every modification thaws it first, which
+ * rebuilds it from regular nodes and unmaps the arena.
+ *
+ * Nodes whose next two levels are dense are finally wrapped in
+ * stride nodes, which are placed at the end of the arena. Children
+ * of stride nodes are skipped by most lookups and not wrapped. The
+ * stride nodes of the mutable array are unwrapped before and built
+ * again with their smaller alphabet by a thaw.
+ */
+
+struct FREEZE
+{
+    uchar *arena;
+    size_t size;
+};
+
+/**
+ * size of a frozen node with `n` subexpanses.
+ */
+static size_t _freeze_node_size(int n)
+{
+    return n <= 7 ? offsetof(struct TINY, nodes) + n * sizeof(JP) : _packed_size(n);
+}
+
+/**
+ * calls `fn` for the slot `root` and every slot below it in preorder.
+ * `fn` may replace the node in the slot before its children are visited.
+ */
+static void _freeze_walk(JP *root, void (*fn)(JP *slot, void *ctx), void *ctx)
+{
+    size_t len = 0;
+    size_t cap = 256;
+
+    JP **stack = malloc(cap * sizeof(JP *));
+
+    stack[len++] = root;
+
+    while (len)
+    {
+        JP *slot = stack[--len];
+
+        fn(slot, ctx);
+
+        uchar keys[256];
+        JP *slots[256];
+
+        int n = _node_children(*slot, keys, slots);
+
+        if (len + n > cap)
+        {
+            cap = 2 * (len + n);
+            stack = realloc(stack, cap * sizeof(JP *));
+        }
+
+        // pushed in reverse so the children are visited in ascending order
+        for (int i = n - 1; i >= 0; --i)
+            if (keys[i])
+                stack[len++] = slots[i];
+    }
+
+    free(stack);
+}
+
+struct CURSOR
+{
+    // next inner node and next bucket
+    uchar *inner;
+    uchar *leaves;
+};
+
+/**
+ * adds the frozen size of the node in `slot` to the
+ * bytes of the inner nodes or of the buckets in `ctx`.
+ */
+static void _freeze_size(JP *slot, void *ctx)
+{
+    size_t *size = ctx;
+
+    if (typeof(*slot) == LEAF)
+        size[1] += _node_size(*slot);
+    else
+        size[0] += _freeze_node_size(_node_count(*slot));
+}
+
+/**
+ * moves the node in `slot` into the arena and stashes the original.
+ * the children are not moved yet.
+ */
+static void _freeze_move(JP *slot, void *ctx)
+{
+    struct CURSOR *cursor = ctx;
+
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    JP node = *slot;
+
+    if (typeof(node) == LEAF)
+    {
+        struct LEAF *leaf = (struct LEAF *)decode(node);
+
+        if (!leaf)
+            return;
+
+        *slot = encode(_leaf_copy(cursor->leaves, leaf, leaf->lines), LEAF);
+        cursor->leaves += _leaf_size(leaf);
+
+        stash(leaf, _leaf_size(leaf));
+
+        return;
+    }
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        nodes[i] = *slots[i];
+
+    void *mem = cursor->inner;
+    cursor->inner += _freeze_node_size(n);
+
+    *slot = n <= 7 ? _node_make(mem, TINY, keys, nodes, n) : _packed_make(mem, keys, nodes, n);
+
+    stash((void *)decode(node), _node_size(node));
+}
+
+/**
+ * adds the bytes of a stride node for `slot` to `ctx`, a bound
+ * since the children of stride nodes are not wrapped.
+ */
+static void _stride_bound(JP *slot, void *ctx)
+{
+    uint64_t bits[4];
+
+    JP node = typeof(*slot) == STRIDE ? _stride_base(*slot) : *slot;
+
+    int size = _stride_select(node, bits, STRIDE_ALPHABET);
+
+    if (size)
+        *(size_t *)ctx += _stride_size(size);
+}
+
+struct MIRROR
+{
+    JP *slot;
+
+    // the slot of a stride node two levels above, which mirrors `slot`
+    JP *mirror;
+};
+
+/**
+ * wraps the dense nodes of the frozen tree below `root` in stride
+ * nodes, which are written at `cursor`. returns the end of them.
+ */
+static uchar *_stride_wrap(JP *root, uchar *cursor)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    uchar next[256];
+    JP *nexts[256];
+
+    size_t len = 0;
+    size_t max = 256;
+
+    struct MIRROR *stack = malloc(max * sizeof(struct MIRROR));
+
+    stack[len++] = (struct MIRROR){root, NULL};
+
+    while (len)
+    {
+        struct MIRROR item = stack[--len];
+
+        uint64_t bits[4];
+        int size = _stride_select(*item.slot, bits, STRIDE_ALPHABET);
+
+        if (size)
+        {
+            JP *nodes = (JP *)(cursor + sizeof(struct STRIDE));
+
+            *item.slot = _stride_make(cursor, nodes, *item.slot, bits, size);
+            cursor += _stride_size(size);
+        }
+
+        if (item.mirror)
+            *item.mirror = *item.slot;
+
+        int n = _node_children(*item.slot, keys, slots);
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (!keys[i])
+                continue;
+
+            // lookups skip the children of a stride node,
+            // so the nodes two levels below are wrapped instead
+            int m = size ? _node_children(*slots[i], next, nexts) : 1;
+
+            if (len + m > max)
+            {
+                max = 2 * (len + m);
+                stack = realloc(stack, max * sizeof(struct MIRROR));
+            }
+
+            if (!size)
+            {
+                stack[len++] = (struct MIRROR){slots[i], NULL};
+                continue;
+            }
+
+            for (int j = 0; j < m; ++j)
+                if (next[j])
+                    stack[len++] = (struct MIRROR){nexts[j], _stride_find(*item.slot, (uchar[]){keys[i], next[j]})};
+        }
+    }
+
+    free(stack);
+
+    return cursor;
+}
+
+/**
+ * wraps the dense nodes of the tree just written from `arena` up
+ * to `cursor` in stride nodes and makes `judy` a frozen array.
+ * the untouched pages at the end of the arena of `size` bytes
+ * are unmapped again.
+ */
+static void _freeze_finish(judy_t *judy, uchar *arena, uchar *cursor, size_t size)
+{
+    cursor = (uchar *)(((uintptr_t)cursor + 63) & ~(uintptr_t)63);
+    cursor = _stride_wrap(&judy->root, cursor);
+
+    size_t used = ((cursor - arena) + 4095) & ~(size_t)4095;
+
+    if (used < size)
+        release_arena(arena + used, size - used);
+
+    struct FREEZE *freeze = malloc(sizeof(struct FREEZE));
+
+    freeze->arena = arena;
+    freeze->size = used < size ? used : size;
+
+    judy->frozen = freeze;
+
+    // every slot has moved
+    ++judy->version;
+
+    _table_rebuild(judy);
+}
+
+void judy_freeze(judy_t *judy)
+{
+    if (!judy->root || judy->frozen || judy->heap || judy->cache)
+        return;
+
+    // stride nodes are rebuilt within the arena
+    _stride_strip(&judy->root);
+
+    size_t size[2] = {};
+    size_t strides = 0;
+
+    _freeze_walk(&judy->root, _freeze_size, size);
+    _freeze_walk(&judy->root, _stride_bound, &strides);
+
+    // the buckets start at a cache line again
+    size_t inner = (size[0] + 63) & ~(size_t)63;
+    size_t leaves = size[1];
+
+    size_t total = inner + leaves + strides;
+
+    uchar *arena = claim_arena(total);
+
+    struct CURSOR cursor = {arena, arena + inner};
+
+    _freeze_walk(&judy->root, _freeze_move, &cursor);
+
+    _freeze_finish(judy, arena, cursor.leaves, total);
+}
+
+void *_freeze_lookup(judy_t *judy, const uchar *key)
+{
+    JP node = judy->root;
+
+    if (judy->table && key[0])
+    {
+        JP next = judy->table[(key[0] << 8) | key[1]];
+
+        if (next)
+        {
+            if (!key[1])
+                return (void *)decode(next);
+
+            node = next;
+            key += 2;
+        }
+    }
+
+    while (1)
+    {
+        uchar cc = *key;
+
+        bool res;
+        switch (typeof(node))
+        {
+        case LEAF:
+            res = _leaf_lookup(&node, key);
+
+            return res ? (void *)decode(node) : NULL;
+        case TINY:
+            res = _tiny_lookup(&node, cc);
+            break;
+        case PACKED:
+            res = _packed_lookup(&node, cc);
+            break;
+        case STRIDE:
+        {
+            JP *slot = _stride_find(node, key);
+
+            // a pair outside the alphabet continues at the wrapped node
+            if (!slot)
+            {
+                node = _stride_base(node);
+                continue;
+            }
+
+            node = *slot;
+            key += 2;
+
+            if (!node)
+                return NULL;
+
+            continue;
+        }
+        default:
+            assert(0);
+        }
+
+        if (res == false)
+            return NULL;
+
+        if (!cc)
+            return (void *)decode(node);
+
+        ++key;
+    }
+
+    __builtin_unreachable();
+}
+
+/**
+ * replaces the frozen node in `slot` by a regular copy.
+ * the children are not copied yet.
+ */
+static void _freeze_copy(JP *slot, void *ctx)
+{
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    JP node = *slot;
+
+    (void)ctx;
+
+    if (typeof(node) == LEAF)
+    {
+        struct LEAF *leaf = (struct LEAF *)decode(node);
+
+        if (leaf)
+            *slot = encode(_leaf_copy(claim(_leaf_size(leaf)), leaf, leaf->lines), LEAF);
+
+        return;
+    }
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        nodes[i] = *slots[i];
+
+    int type = _node_type(n);
+
+    *slot = _node_make(claim(_node_type_size(type)), type, keys, nodes, n);
+}
+
+void _freeze_thaw(judy_t *judy)
+{
+    _freeze_walk(&judy->root, _freeze_copy, NULL);
+
+    _freeze_free(judy);
+
+    _stride_grow_all(&judy->root);
+
+    ++judy->version;
+
+    _table_rebuild(judy);
+}
+
+void _freeze_free(judy_t *judy)
+{
+    if (!judy->frozen)
+        return;
+
+    release_arena(judy->frozen->arena, judy->frozen->size);
+
+    free(judy->frozen);
+
+    judy->frozen = NULL;
+}
+
+size_t _freeze_bytes(judy_t *judy)
+{
+    return judy->frozen->size;
+}
+
+size_t _freeze_node_bytes(JP node)
+{
+    switch (typeof(node))
+    {
+    case TINY:
+        return _freeze_node_size(__builtin_popcount(((struct TINY *)decode(node))->mask));
+    case STRIDE:
+        return _stride_bytes(node) + _freeze_node_bytes(_stride_base(node));
+    default:
+        return _node_size(node);
+    }
+}
+
+/**
+ * Minimized arrays:
+ *
+ * judy_minimize freezes the array bottom up. Every node is written
+ * to the arena after its children, whose slots hold the shared
+ * copies by then, so two subtrees are identical if the bytes of
+ * their roots are. A table of all written nodes by the hash of
+ * their bytes finds an identical node which was written before.
+ * The duplicate is always the last node in the arena, so it is
+ * dropped again by rewinding the cursor.
+ */
+
+struct SHARE
+{
+    uchar *arena;
+    uchar *cursor;
+
+    // written nodes, open addressing
+    JP *table;
+    size_t mask;
+
+    // whether the original nodes are regular ones to be stashed
+    bool stash;
+};
+
+struct FRAME
+{
+    JP *slot;
+    bool done;
+};
+
+/**
+ * adds a bound of the bytes of the node in `slot` to `ctx[0]`
+ * and counts it in `ctx[1]`.
+ */
+static void _share_size(JP *slot, void *ctx)
+{
+    size_t *size = ctx;
+
+    // buckets may need to be aligned
+    if (typeof(*slot) == LEAF)
+        size[0] += _node_size(*slot) + 64;
+    else
+        size[0] += _freeze_node_size(_node_count(*slot));
+
+    ++size[1];
+}
+
+static uint64_t _share_hash(const uint64_t *words, size_t n)
+{
+    uint64_t hash = n;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        hash ^= words[i];
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+    }
+
+    return hash;
+}
+
+/**
+ * the node identical to the one just written from `mem` to the
+ * cursor or the new node itself, which is added to the table.
+ */
+static JP _share_intern(struct SHARE *share, uchar *from, uchar *mem, JP node)
+{
+    size_t size = share->cursor - mem;
+    size_t slot = _share_hash((uint64_t *)mem, size / 8) & share->mask;
+
+    for (; share->table[slot]; slot = (slot + 1) & share->mask)
+    {
+        JP other = share->table[slot];
+
+        if (typeof(other) != typeof(node) || _freeze_node_bytes(other) != size)
+            continue;
+
+        if (memcmp((void *)decode(other), mem, size))
+            continue;
+
+        // nodes are written into zeroed memory
+        memset(from, 0, share->cursor - from);
+        share->cursor = from;
+
+        return other;
+    }
+
+    share->table[slot] = node;
+
+    return node;
+}
+
+/**
+ * writes the frozen copy of `node`, whose children are shared
+ * already, and returns the shared copy.
+ */
+static JP _share_node(struct SHARE *share, JP node)
+{
+    uchar keys[256];
+    JP *slots[256];
+    JP nodes[256];
+
+    uchar *from = share->cursor;
+    JP copy;
+
+    if (typeof(node) == LEAF)
+    {
+        struct LEAF *leaf = (struct LEAF *)decode(node);
+
+        if (!leaf)
+            return node;
+
+        uchar *mem = (uchar *)(((uintptr_t)from + 63) & ~(uintptr_t)63);
+
+        // identical buckets have to be identical bytes
+        struct LEAF *dup = _leaf_copy(mem, leaf, _leaf_lines(leaf->count, leaf->used));
+
+        memset(&dup->heads[dup->count], 0, sizeof(dup->heads) - dup->count);
+
+        share->cursor = mem + _leaf_size(dup);
+
+        copy = _share_intern(share, from, mem, encode(dup, LEAF));
+    }
+    else
+    {
+        int n = _node_children(node, keys, slots);
+
+        for (int i = 0; i < n; ++i)
+            nodes[i] = *slots[i];
+
+        share->cursor += _freeze_node_size(n);
+
+        copy = n <= 7 ? _node_make(from, TINY, keys, nodes, n) : _packed_make(from, keys, nodes, n);
+        copy = _share_intern(share, from, from, copy);
+    }
+
+    if (share->stash)
+        stash((void *)decode(node), _node_size(node));
+
+    return copy;
+}
+
+void judy_minimize(judy_t *judy)
+{
+    if (!judy->root || judy->heap || judy->cache)
+        return;
+
+    if (!judy->frozen)
+        _stride_strip(&judy->root);
+
+    size_t size[2] = {};
+
+    _freeze_walk(&judy->root, _share_size, size);
+    _freeze_walk(&judy->root, _stride_bound, &size[0]);
+
+    size_t cap = 1;
+
+    while (cap < 2 * size[1])
+        cap *= 2;
+
+    struct SHARE share = {
+        .arena = claim_arena(size[0]),
+        .table = calloc(cap, sizeof(JP)),
+        .mask = cap - 1,
+        .stash = !judy->frozen,
+    };
+
+    share.cursor = share.arena;
+
+    // postorder, a node is shared once all of its children are
+    size_t len = 0;
+    size_t max = 256;
+
+    struct FRAME *stack = malloc(max * sizeof(struct FRAME));
+
+    stack[len++] = (struct FRAME){&judy->root, false};
+
+    while (len)
+    {
+        struct FRAME frame = stack[--len];
+
+        if (frame.done)
+        {
+            *frame.slot = _share_node(&share, *frame.slot);
+            continue;
+        }
+
+        uchar keys[256];
+        JP *slots[256];
+
+        int n = _node_children(*frame.slot, keys, slots);
+
+        if (len + n + 1 > max)
+        {
+            max = 2 * (len + n + 1);
+            stack = realloc(stack, max * sizeof(struct FRAME));
+        }
+
+        stack[len++] = (struct FRAME){frame.slot, true};
+
+        for (int i = 0; i < n; ++i)
+            if (keys[i])
+                stack[len++] = (struct FRAME){slots[i], false};
+    }
+
+    free(stack);
+    free(share.table);
+
+    // a frozen array has been rebuilt from its own arena
+    _freeze_free(judy);
+
+    _freeze_finish(judy, share.arena, share.cursor, size[0]);
+}
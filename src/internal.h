@@ -9,6 +9,8 @@
 
 #include <assert.h>
 
+#include "judy.h"
+
 typedef uint8_t uchar;
 
 #define JUDY_MASK_PTR 0x0000fffffffffff8ull
@@ -37,6 +39,8 @@ enum
     LEAF,
     TINY,
     TRIE,
+    PACKED,
+    STRIDE,
 };
 
 
@@ -47,11 +51,281 @@ enum
  * 
  * static bool _{name}_insert(JP **nodeptr, uchar cc);
  * 
+ * static JP *_{name}_find(JP node, uchar cc);
+ * 
+ */
+
+int _judy_insert(judy_t *judy, JP *nodeptr, const uchar *key, int depth, void *val, JP **path);
+
+/**
+ * writes the value of `key` into its value slot `slot` of `depth`
+ * and does the bookkeeping of every insert: counters, the root
+ * accelerator and the filter. all inserts store through here.
+ */
+void _judy_store(judy_t *judy, JP *slot, const uchar *key, int depth, void *val);
+
+/**
+ * refreshes the root accelerator entry for the prefix of `key`.
+ * has to be called after every modification that might have
+ * replaced the node of depth 2 on the path of `key`.
+ */
+void _table_update(judy_t *judy, const uchar *key);
+
+/**
+ * recomputes every entry of the root accelerator.
+ * has to be called after nodes have been moved.
+ */
+void _table_rebuild(judy_t *judy);
+
+// adaptive node selection
+
+#define ADAPT_RATE 64
+
+/**
+ * decides whether the current lookup is sampled,
+ * which happens for one in ADAPT_RATE lookups per thread.
+ */
+static inline bool _adapt_sample(void)
+{
+    static __thread uint32_t tick;
+
+    return ++tick % ADAPT_RATE == 0;
+}
+
+/**
+ * judy_lookup which records the visited nodes.
+ */
+void *_adapt_lookup(judy_t *judy, const uchar *key);
+
+// cache mode
+
+/**
+ * marks a value slot as recently used, see judy_cache().
+ * values are at least 8 byte aligned so the bit is free.
+ */
+#define CACHE_REF 0x4ull
+
+/**
+ * judy_lookup which marks the value as recently used.
+ */
+void *_cache_lookup(judy_t *judy, const uchar *key);
+
+void _cache_free(judy_t *judy);
+
+/**
+ * charges the bytes claimed by the calling thread
+ * since `before` to the cache of `judy`.
+ */
+void _cache_account(judy_t *judy, int64_t before);
+
+/**
+ * charges the bytes claimed since `before` and evicts keys until
+ * the cache is back within its limit. `keep`, the key just inserted
+ * or NULL, is never evicted.
+ */
+void _cache_settle(judy_t *judy, int64_t before, const uchar *keep);
+
+// frozen arrays, see judy_freeze()
+
+/**
+ * judy_lookup on the packed nodes of a frozen judy array.
+ */
+void *_freeze_lookup(judy_t *judy, const uchar *key);
+
+/**
+ * rebuilds a frozen judy array from regular nodes so it can be
+ * modified again. has to be called before every modification.
+ */
+void _freeze_thaw(judy_t *judy);
+
+void _freeze_free(judy_t *judy);
+
+/**
+ * bytes of the arena of a frozen judy array.
+ */
+size_t _freeze_bytes(judy_t *judy);
+
+/**
+ * size of `node` of a frozen judy array, whose TINY nodes are cut down.
+ */
+size_t _freeze_node_bytes(JP node);
+
+// stride nodes, see nodes/stride.h
+
+/**
+ * collects the alphabet of the two levels below `node` in `bits`.
+ * returns its size if they are dense enough for a stride node with
+ * an alphabet of at most `alphabet` chars or 0. keys ending in
+ * between are left to the wrapped node, children which are buckets
+ * would have no second level.
+ */
+int _stride_select(JP node, uint64_t *bits, int alphabet);
+
+/**
+ * builds a stride node wrapping `node` into the zeroed memory `mem`
+ * with its table at the zeroed memory `nodes`.
+ */
+JP _stride_make(void *mem, JP *nodes, JP node, const uint64_t *bits, int size);
+
+/**
+ * reads the row of `cc` in the table of the mutable stride node
+ * `node` again from the wrapped node.
+ */
+void _stride_sync(JP node, uchar cc);
+
+/**
+ * reads the whole table of the mutable stride node `node` again.
+ */
+void _stride_refresh(JP node);
+
+/**
+ * wraps the node in `slot` in a mutable stride node if its next two
+ * levels are dense, or rebuilds the stride node in it if the alphabet
+ * has changed. stride nodes among its children are unwrapped.
+ * returns false if nothing has changed.
+ */
+bool _stride_grow(JP *slot);
+
+/**
+ * _stride_grow for the node of `depth` on the path of `key`, unless
+ * it is the child of a stride node. keeps the stride node two levels
+ * above and the root accelerator in line.
+ */
+bool _stride_grow_at(judy_t *judy, const uchar *key, int depth);
+
+/**
+ * has to be called after the node of `depth` on the path of `key` got
+ * replaced other than by an insert, since a stride node may mirror it.
+ */
+void _stride_touch(judy_t *judy, const uchar *key, int depth);
+
+/**
+ * unwraps all mutable stride nodes below `slot`.
+ */
+void _stride_strip(JP *slot);
+
+/**
+ * wraps the dense nodes below `root`
+ * like judy_freeze does, with the alphabet of mutable stride nodes.
+ */
+void _stride_grow_all(JP *root);
+
+// negative lookup filter, see judy_filter()
+
+/**
+ * false if `key` is certainly not in the judy array.
+ */
+bool _filter_test(judy_t *judy, const uchar *key);
+
+void _filter_add(judy_t *judy, const uchar *key);
+
+/**
+ * counts a removed key, whose bits stay set until the next rebuild.
+ */
+void _filter_remove(judy_t *judy);
+
+/**
+ * grows or rebuilds the filter if it has become too full or
+ * stale. has to be called after every modification once the
+ * tree is consistent again, since it rebuilds from its keys.
+ */
+void _filter_settle(judy_t *judy);
+
+/**
+ * sets the bits of the keys in the tree from scratch.
+ */
+void _filter_rebuild(judy_t *judy);
+
+void _filter_free(judy_t *judy);
+
+size_t _filter_bytes(judy_t *judy);
+
+// instrumentation, see judy_counters_get()
+
+#ifdef JUDY_COUNTERS
+
+/**
+ * the counters of the calling thread.
+ */
+judy_counters_t *_counters_local(void);
+
+static inline void _count_visit(int type, bool hit)
+{
+    judy_counters_t *counters = _counters_local();
+
+    ++counters->visits[type];
+    ++(hit ? counters->hits : counters->misses)[type];
+}
+
+static inline void _count_hist(uint64_t *bins, uint64_t value)
+{
+    int bin = value ? 64 - __builtin_clzll(value) : 0;
+
+    ++bins[bin < JUDY_COUNTERS_BINS ? bin : JUDY_COUNTERS_BINS - 1];
+}
+
+#define COUNT(field) (++_counters_local()->field)
+#define COUNT_VISIT(type, hit) _count_visit(type, hit)
+#define COUNT_HIST(field, value) _count_hist(_counters_local()->field, value)
+
+#else
+
+#define COUNT(field) ((void)0)
+#define COUNT_VISIT(type, hit) ((void)0)
+#define COUNT_HIST(field, value) ((void)sizeof(value))
+
+#endif
+
+// size classes of claim() in the order of judy_counters_t
+enum
+{
+    N64,
+    N128,
+    N256,
+    N2048,
+    CLASSES,
+};
+
+// persistent mode
+
+/**
+ * makes claim() and stash() of the calling thread use the file
+ * of a persistent judy array or the node pool if `heap` is NULL.
+ * returns the previous heap in order to restore it afterwards.
+ */
+struct HEAP *_heap_enter(struct HEAP *heap);
+
+/**
+ * allocates a node of size class `cls` from `heap`.
  */
+void *_heap_claim(struct HEAP *heap, int cls, size_t size);
 
+void _heap_stash(struct HEAP *heap, int cls, void *ptr);
+
+/**
+ * syncs and unmaps the file of a persistent judy array.
+ */
+void _heap_close(judy_t *judy);
 
 void *claim(size_t size);
 
 void stash(void *ptr, size_t size);
 
+/**
+ * maps a fresh zeroed region of `size` bytes which is 64 byte aligned.
+ * nodes carved from it can be passed to stash() individually.
+ */
+void *claim_arena(size_t size);
+
+/**
+ * unmaps a region of claim_arena() none of whose nodes were stashed.
+ */
+void release_arena(void *ptr, size_t size);
+
+/**
+ * the bytes claimed minus the bytes stashed by the calling thread.
+ * the difference of two calls is what happened in between.
+ */
+int64_t claimed(void);
+
 #endif
@@ -8,12 +8,120 @@
 #include "nodes/trie.h"
 #include "nodes/tiny.h"
 #include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
 
 
+/**
+ * decodes a single char of a key starting at `node`.
+ * fails at leaf buckets which only resolve whole suffixes.
+ */
+static bool _judy_step(JP *node, uchar cc)
+{
+    switch (typeof(*node))
+    {
+    case LEAF:
+        return false;
+    case TINY:
+        return _tiny_lookup(node, cc);
+    case TRIE:
+        return _trie_lookup(node, cc);
+    case PACKED:
+        return _packed_lookup(node, cc);
+    case STRIDE:
+        *node = _stride_base(*node);
+        return _judy_step(node, cc);
+    default:
+        assert(0);
+    }
+
+    __builtin_unreachable();
+}
+
+// root accelerator
+
+#define TABLE_SIZE 65536
+
+/**
+ * resolves the node of depth 2 below `root` for the chars `c0` and `c1`.
+ * if `c1` is '\0' this is the value of the single char key `c0`.
+ */
+static JP _table_resolve(JP root, uchar c0, uchar c1)
+{
+    JP node = root;
+
+    if (!_judy_step(&node, c0) || !node)
+        return (JP)0;
+
+    if (!_judy_step(&node, c1))
+        return (JP)0;
+
+    return node;
+}
+
+void _table_update(judy_t *judy, const uchar *key)
+{
+    if (!judy->table || !key[0])
+        return;
+
+    judy->table[(key[0] << 8) | key[1]] = _table_resolve(judy->root, key[0], key[1]);
+}
+
+void _table_rebuild(judy_t *judy)
+{
+    if (!judy->table)
+        return;
+
+    // entry 0x00XX belongs to the empty key which
+    // is shorter than the table and never used
+    for (int c0 = 1; c0 < 256; ++c0)
+        for (int c1 = 0; c1 < 256; ++c1)
+            judy->table[(c0 << 8) | c1] = _table_resolve(judy->root, c0, c1);
+}
+
+void judy_accelerate(judy_t *judy)
+{
+    if (judy->table)
+        return;
+
+    judy->table = calloc(TABLE_SIZE, sizeof(JP));
+
+    _table_rebuild(judy);
+}
+
 void *judy_lookup(judy_t *judy, const uchar *key)
 {
     JP node = judy->root;
 
+    if (judy->filter && !_filter_test(judy, key))
+        return NULL;
+
+    if (judy->frozen)
+        return _freeze_lookup(judy, key);
+
+    if (judy->adapt && _adapt_sample())
+        return _adapt_lookup(judy, key);
+
+    if (judy->cache)
+        return _cache_lookup(judy, key);
+
+    // an empty entry means either a missing prefix or a prefix
+    // that isn't accelerated so we fall back to the root.
+    if (judy->table && key[0])
+    {
+        JP next = judy->table[(key[0] << 8) | key[1]];
+
+        if (next)
+        {
+            if (!key[1])
+                return (void *)decode(next);
+
+            node = next;
+            key += 2;
+        }
+    }
+
     while (1)
     {
         uchar cc = *key;
@@ -22,14 +130,43 @@ void *judy_lookup(judy_t *judy, const uchar *key)
         switch (typeof(node))
         {
         case LEAF:
-            res = _leaf_lookup(&node, cc);
-            break;
+            // a bucket resolves the rest of the key at once
+            res = _leaf_lookup(&node, key);
+
+            COUNT_VISIT(LEAF, res);
+
+            return res ? (void *)decode(node) : NULL;
         case TINY:
             res = _tiny_lookup(&node, cc);
+
+            COUNT_VISIT(TINY, res);
             break;
         case TRIE:
             res = _trie_lookup(&node, cc);
+
+            COUNT_VISIT(TRIE, node != 0);
             break;
+        case STRIDE:
+        {
+            JP *slot = _stride_find(node, key);
+
+            // a pair outside the alphabet continues at the wrapped node
+            if (!slot)
+            {
+                node = _stride_base(node);
+                continue;
+            }
+
+            node = *slot;
+            key += 2;
+
+            COUNT_VISIT(STRIDE, node != 0);
+
+            if (!node)
+                return NULL;
+
+            continue;
+        }
         default:
             assert(0);
         }
@@ -49,106 +186,401 @@ void *judy_lookup(judy_t *judy, const uchar *key)
     __builtin_unreachable();
 }
 
-void judy_insert(judy_t *judy, const uchar *key, void *val)
+/**
+ * a stride node passed by an insert. once the insert is done with
+ * the two levels below it, the slot it stepped through in the table
+ * is written back into the wrapped node or, if it went through the
+ * wrapped node, the row of the first char is read again.
+ */
+struct PASS
+{
+    JP stride;
+    uchar pair[2];
+
+    // the slot in the table and its node before or NULL
+    JP *slot;
+    JP node;
+};
+
+static void _judy_pass(struct PASS *pass)
 {
-    JP *nodeptr = &judy->root;
+    if (!pass->stride)
+        return;
+
+    if (!pass->slot)
+    {
+        _stride_sync(pass->stride, pass->pair[0]);
+    }
+    else if (*pass->slot != pass->node)
+    {
+        JP *child = _node_find(_stride_base(pass->stride), pass->pair[0]);
+
+        *_node_find(*child, pass->pair[1]) = *pass->slot;
+    }
+
+    pass->stride = (JP)0;
+}
+
+/**
+ * inserts `key` starting at the slot `nodeptr` which holds the node
+ * of depth `depth`, i.e. the chars before `key + depth` are decoded.
+ *
+ * if `path` is given the slot of every node of depth up to
+ * JUDY_FINGER_DEPTH is recorded, except for the slots mirrored by
+ * a stride node, which are NULL. returns the depth of the last node.
+ */
+int _judy_insert(judy_t *judy, JP *nodeptr, const uchar *key, int depth, void *val, JP **path)
+{
+    // inner nodes created for this key alone
+    int chain = 0;
+
+    // stride nodes passed at the last three depths
+    struct PASS passes[3] = {};
 
-    // traverse the judy array by decoding char by char until
-    // a node is reached which no longer contains the remaining key
+    // the deepest depth below a stride node and the node
+    // above a burst or promoted node which may have become dense
+    int shadow = -1;
+    int dense = -1;
+
+    // traverse the judy array by decoding char by char
+    // until the rest of the key ends up in a leaf bucket
     while (1)
     {
-        uchar cc = *key;
+        uchar cc = key[depth];
+        JP *slot = nodeptr;
+        JP type = typeof(*slot);
 
-        bool res;
-        switch (typeof(*nodeptr))
+        // done with the two levels below the stride node three levels up
+        _judy_pass(&passes[depth % 3]);
+
+        if (path && depth <= JUDY_FINGER_DEPTH)
+            path[depth] = depth <= shadow ? NULL : slot;
+
+        if (type == LEAF)
+        {
+            // an empty subexpanse becomes a new bucket
+            if (_leaf_insert(&nodeptr, key + depth))
+                goto STORE;
+
+            // the suffix doesn't fit, so the rest of the key
+            // continues in an inner node and is tried again
+            if (*slot)
+            {
+                _leaf_burst(slot);
+                ++judy->version;
+
+                // so may the two levels above have become dense
+                if (depth > 0)
+                    dense = depth - 1;
+            }
+            else
+            {
+                *slot = encode(claim(sizeof(struct TINY)), TINY);
+
+                COUNT(expands);
+                ++chain;
+            }
+
+            continue;
+        }
+
+        if (type == STRIDE)
+        {
+            struct PASS *pass = &passes[depth % 3];
+            JP *next = _stride_find(*slot, key + depth);
+
+            *pass = (struct PASS){*slot, {cc, 0}, NULL, 0};
+            shadow = depth + 2;
+
+            // a known pair skips the wrapped node and its child
+            if (next && *next)
+            {
+                pass->pair[1] = key[depth + 1];
+                pass->slot = next;
+                pass->node = *next;
+
+                _judy_pass(&passes[(depth + 1) % 3]);
+
+                if (path && depth + 1 <= JUDY_FINGER_DEPTH)
+                    path[depth + 1] = NULL;
+
+                nodeptr = next;
+                depth += 2;
+                continue;
+            }
+
+            slot = &((struct STRIDE *)decode(*slot))->node;
+            nodeptr = slot;
+            type = typeof(*slot);
+        }
+
+        switch (type)
         {
-        case LEAF:
-            res = _leaf_insert(&nodeptr, cc);
-            break;
         case TINY:
-            res = _tiny_insert(&nodeptr, cc);
+            _tiny_insert(&nodeptr, cc);
             break;
         case TRIE:
-            res = _trie_insert(&nodeptr, cc);
+            _trie_insert(&nodeptr, cc);
             break;
         }
 
-        if (res == false)
-            break;
+        // the node got promoted which invalidates every slot pointer
+        // into the old node, and may have made the two levels above dense
+        if (typeof(*slot) != type)
+        {
+            ++judy->version;
 
+            if (depth > 0)
+                dense = depth - 1;
+        }
+
+        // either the key is already present and only the
+        // value has to be replaced or it ends in a new slot
         if (!cc)
-            break;
+            goto STORE;
 
-        ++key;
+        ++depth;
     }
 
-// at this point `key` points to the remaining undecoded
-// chars and `node` points to an empty leaf node.
-// From here new nodes get allocated.
-EXPAND:
+// all that is left to be done is write the value to the slot.
+STORE:
+    COUNT_HIST(chain, chain);
 
-    while (1)
-    {
-        uchar cc = *key;
+    for (int i = 0; i < 3; ++i)
+        _judy_pass(&passes[i]);
 
-        // // old:
-        // struct TRIE *trie = claim(sizeof(struct TRIE));
-        // *nodeptr = encode(trie, TRIE);
-        // nodeptr = &trie->nodes[cc];
+    _judy_store(judy, nodeptr, key, depth, val);
 
-        // new:
-        struct TINY *tiny = claim(sizeof(struct TINY));
-        *nodeptr = encode(tiny, TINY);
-        _tiny_insert(&nodeptr, cc);
+    // the two levels below a new stride node are mirrored now
+    if (dense >= 0 && _stride_grow_at(judy, key, dense) && path)
+        for (int i = dense + 1; i <= dense + 2 && i <= JUDY_FINGER_DEPTH; ++i)
+            path[i] = NULL;
 
-        if (!cc)
-            break;
+    return depth;
+}
 
-        ++key;
-    }
+void _judy_store(judy_t *judy, JP *slot, const uchar *key, int depth, void *val)
+{
+    *slot = encode(val, LEAF);
+
+    // a stored key counts as referenced, like a hit
+    if (judy->cache)
+        *slot |= CACHE_REF;
+
+    COUNT_HIST(length, strlen((const char *)key));
+    COUNT_HIST(depth, depth);
 
-// we can assume that `key` is pointing to '\0' so
-// all that is left to be done is write the value to a leaf node.
-    *nodeptr = encode(val, LEAF);
+    _table_update(judy, key);
+
+    if (judy->filter)
+        _filter_add(judy, key);
 }
 
-void judy_create(judy_t *judy)
+void judy_insert(judy_t *judy, const uchar *key, void *val)
 {
-    judy->root = (JP)0;
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    int64_t before = claimed();
+
+    _judy_insert(judy, &judy->root, key, 0, val, NULL);
+
+    if (judy->cache)
+        _cache_settle(judy, before, key);
+
+    if (judy->filter)
+        _filter_settle(judy);
+
+    _heap_enter(heap);
 }
 
-void judy_delete(judy_t *judy)
+/**
+ * removes with `remove` below the node wrapped by the stride node in
+ * `slot`, which is dropped together with it once it is empty.
+ */
+static bool _judy_remove_stride(JP *slot, const uchar *key, bool (*remove)(JP *slot, const uchar *key))
 {
+    JP node = *slot;
+
+    if (!remove(&((struct STRIDE *)decode(node))->node, key))
+        return false;
+
+    if (_stride_base(node))
+    {
+        _stride_sync(node, *key);
+        return true;
+    }
+
+    _stride_free(node);
+
+    *slot = (JP)0;
+    return true;
 }
 
-// internal allocator
+/**
+ * removes the rest of `key` below the node in `slot`.
+ * returns false if the key can't be found.
+ */
+static bool _judy_remove(JP *slot, const uchar *key)
+{
+    if (typeof(*slot) == LEAF)
+        return _leaf_remove(slot, key);
+
+    if (typeof(*slot) == STRIDE)
+        return _judy_remove_stride(slot, key, _judy_remove);
+
+    JP *child = _node_find(*slot, *key);
+
+    if (!child || !*child)
+        return false;
+
+    if (*key)
+    {
+        if (!_judy_remove(child, key + 1))
+            return false;
+
+        if (*child)
+            return true;
+    }
+
+    // the subexpanse of `*key` is empty by now
+    _node_erase(slot, *key);
+
+    return true;
+}
 
-enum
+void judy_remove(judy_t *judy, const uchar *key)
 {
-    N2048,
-    N64,
-};
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    int64_t before = claimed();
+
+    if (_judy_remove(&judy->root, key))
+    {
+        if (judy->cache)
+            _cache_account(judy, before);
+
+        // removals stash or shrink nodes on the path
+        ++judy->version;
 
-int numallocs[2] = {};
+        _table_update(judy, key);
+
+        if (judy->filter)
+        {
+            _filter_remove(judy);
+            _filter_settle(judy);
+        }
+    }
+
+    _heap_enter(heap);
+}
 
-void *claim(size_t size)
+/**
+ * removes all keys starting with the rest of `prefix` below the
+ * node in `slot`. returns false if there are none.
+ */
+static bool _judy_remove_prefix(JP *slot, const uchar *prefix)
 {
-    switch (size)
+    if (!*slot)
+        return false;
+
+    // every key below starts with the prefix,
+    // so the subtree is detached as a whole
+    if (!*prefix)
     {
-    case 64:
-        ++numallocs[N64];
-        break;
-    case 2048:
-        ++numallocs[N2048];
-        break;
-    default:
-        assert(0);
+        _node_release(*slot);
+
+        *slot = (JP)0;
+        return true;
     }
 
-    return calloc(1, size);
+    if (typeof(*slot) == LEAF)
+        return _leaf_remove_prefix(slot, prefix);
+
+    if (typeof(*slot) == STRIDE)
+        return _judy_remove_stride(slot, prefix, _judy_remove_prefix);
+
+    JP *child = _node_find(*slot, *prefix);
+
+    if (!child || !*child)
+        return false;
+
+    if (!_judy_remove_prefix(child, prefix + 1))
+        return false;
+
+    if (!*child)
+        _node_erase(slot, *prefix);
+
+    return true;
 }
 
-void stash(void *ptr, size_t size)
+void judy_remove_prefix(judy_t *judy, const uchar *prefix)
 {
-    free(ptr);
+    if (judy->frozen)
+        _freeze_thaw(judy);
+
+    struct HEAP *heap = _heap_enter(judy->heap);
+
+    int64_t before = claimed();
+
+    if (_judy_remove_prefix(&judy->root, prefix))
+    {
+        if (judy->cache)
+            _cache_account(judy, before);
+
+        ++judy->version;
+
+        // all accelerated entries below a short prefix are gone
+        if (judy->table && !prefix[0])
+            memset(judy->table, 0, TABLE_SIZE * sizeof(JP));
+        else if (judy->table && !prefix[1])
+            memset(&judy->table[prefix[0] << 8], 0, 256 * sizeof(JP));
+        else
+            _table_update(judy, prefix);
+
+        // the number of removed keys is unknown, so the
+        // stale bits are only dropped by a full rebuild
+        if (judy->filter)
+            _filter_rebuild(judy);
+    }
+
+    _heap_enter(heap);
+}
+
+void judy_create(judy_t *judy)
+{
+    judy->root = (JP)0;
+    judy->table = NULL;
+    judy->version = 0;
+    judy->adapt = NULL;
+    judy->cache = NULL;
+    judy->heap = NULL;
+    judy->frozen = NULL;
+    judy->filter = NULL;
+}
+
+void judy_delete(judy_t *judy)
+{
+    // the nodes of a persistent judy array stay in its file
+    if (judy->heap)
+        _heap_close(judy);
+    else if (!judy->frozen)
+        _node_release(judy->root);
+
+    judy->root = (JP)0;
+
+    free(judy->table);
+    judy->table = NULL;
+
+    free(judy->adapt);
+    judy->adapt = NULL;
+
+    _cache_free(judy);
+    _freeze_free(judy);
+    _filter_free(judy);
 }
@@ -2,17 +2,142 @@
 #define __JUDY_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 typedef uint8_t uchar;
 
 typedef struct JUDY
 {
     uintptr_t root;
+
+    // optional root accelerator, see judy_accelerate()
+    uintptr_t *table;
+
+    // bumped whenever nodes are replaced, see judy_finger_t
+    uint64_t version;
+
+    // optional adaptive node selection, see judy_adaptive()
+    struct ADAPT *adapt;
+
+    // optional memory bound, see judy_cache()
+    struct CACHE *cache;
+
+    // file backing a persistent judy array, see judy_open_persistent()
+    struct HEAP *heap;
+
+    // arena of a frozen judy array, see judy_freeze()
+    struct FREEZE *frozen;
+
+    // optional negative lookup filter, see judy_filter()
+    struct FILTER *filter;
 } judy_t;
 
+#define JUDY_FINGER_DEPTH 64
+
+/**
+ * caches the last root-to-leaf path of a judy array.
+ * the following operations resume at the deepest node
+ * shared with the previous key instead of the root.
+ */
+typedef struct JUDY_FINGER
+{
+    judy_t *judy;
+
+    // the version of `judy` the path was recorded in
+    uint64_t version;
+
+    // number of cached key chars
+    int depth;
+
+    uchar key[JUDY_FINGER_DEPTH];
+
+    // path[i] is the slot holding the node of depth i
+    uintptr_t *path[JUDY_FINGER_DEPTH + 1];
+} judy_finger_t;
+
 void judy_create(judy_t *judy);
 void judy_delete(judy_t *judy);
 
+/**
+ * population and memory footprint of a judy array.
+ */
+typedef struct JUDY_STATS
+{
+    size_t keys;
+
+    // depth of the deepest node
+    size_t depth;
+
+    // number of nodes by type
+    size_t tiny;
+    size_t trie;
+    size_t leaf;
+    size_t packed;
+    size_t stride;
+
+    // bytes of the nodes by type, stride nodes include the node they wrap.
+    // shared subtrees of minimized arrays count once per reference
+    size_t tiny_bytes;
+    size_t trie_bytes;
+    size_t leaf_bytes;
+    size_t packed_bytes;
+    size_t stride_bytes;
+
+    // bytes used by nodes, the root accelerator and the filter
+    size_t bytes;
+} judy_stats_t;
+
+#define JUDY_COUNTERS_BINS 16
+
+/**
+ * hot path counters, only collected if the library is built with
+ * JUDY_COUNTERS defined. the histograms are binned by powers of two,
+ * bin `i` counts the values in [2^(i-1), 2^i) and the last bin the rest.
+ */
+typedef struct JUDY_COUNTS
+{
+    // steps of judy_lookup by node type: leaf buckets, TINY, TRIE,
+    // PACKED and STRIDE. PACKED nodes only exist in frozen arrays
+    uint64_t visits[5];
+    uint64_t hits[5];
+    uint64_t misses[5];
+
+    // TINY nodes turned into TRIE nodes and TRIE nodes into TINY nodes
+    uint64_t promotions;
+    uint64_t demotions;
+
+    // leaf buckets burst into inner nodes
+    uint64_t bursts;
+
+    // inner nodes created for suffixes too long for a leaf bucket
+    uint64_t expands;
+
+    // claim() and stash() calls by size class of 64, 128, 256 and 2048 bytes
+    uint64_t claims[4];
+    uint64_t stashes[4];
+
+    // lengths of inserted keys and depths of the nodes they end in
+    uint64_t length[JUDY_COUNTERS_BINS];
+    uint64_t depth[JUDY_COUNTERS_BINS];
+
+    // expands by a single insert, the inner nodes of its EXPAND chain
+    uint64_t chain[JUDY_COUNTERS_BINS];
+} judy_counters_t;
+
+/**
+ * sums up the counters of all threads, including threads which
+ * have exited. counters are kept per thread and read without
+ * stopping the other threads, so the sum is only approximate
+ * while they keep running. all zero unless built with JUDY_COUNTERS.
+ */
+void judy_counters_get(judy_counters_t *counters);
+
+/**
+ * sets the counters of all threads back to zero.
+ */
+void judy_counters_reset(void);
+
 /**
  * finds the value associated with the '\0'-terminated string key.
  * returns NULL if it can't be found.
@@ -25,10 +150,223 @@ void *judy_lookup(judy_t *judy, const uchar *key);
  */
 void judy_insert(judy_t *judy, const uchar *key, void *val);
 
+/**
+ * lookups and inserts specialized for keys of exactly 8, 16 or 32
+ * bytes, which may contain '\0'. the descent is unrolled and the
+ * value is stored right at the last byte without a terminator.
+ * a judy array can only be used with one of these key lengths, not
+ * with the other functions of this api, and has to be released by
+ * the matching judy_deleteK().
+ */
+void *judy_lookup8(judy_t *judy, const uchar *key);
+void *judy_lookup16(judy_t *judy, const uchar *key);
+void *judy_lookup32(judy_t *judy, const uchar *key);
+
+void judy_insert8(judy_t *judy, const uchar *key, void *val);
+void judy_insert16(judy_t *judy, const uchar *key, void *val);
+void judy_insert32(judy_t *judy, const uchar *key, void *val);
+
+void judy_delete8(judy_t *judy);
+void judy_delete16(judy_t *judy);
+void judy_delete32(judy_t *judy);
+
+/**
+ * inserts the `n` keys with their values in one go.
+ * the batch is radix sorted internally so the path to every
+ * node is decoded once and each node grows to its final type
+ * at once. of duplicate keys the last one in the batch wins.
+ */
+void judy_insert_batch(judy_t *judy, const uchar **keys, void **vals, size_t n);
+
+/**
+ * binds an empty finger to the judy array.
+ */
+void judy_finger_init(judy_finger_t *finger, judy_t *judy);
+
+/**
+ * same as judy_lookup but resumes from the path of the previous
+ * key used with `finger`. keys sharing long prefixes in consecutive
+ * calls (sorted or clustered streams) only decode their suffix.
+ */
+void *judy_lookup_finger(judy_finger_t *finger, const uchar *key);
+
+/**
+ * same as judy_insert but resumes from the path
+ * of the previous key used with `finger`.
+ */
+void judy_insert_finger(judy_finger_t *finger, const uchar *key, void *val);
+
+/**
+ * enables the root accelerator for this judy array.
+ * a 65536 entry table indexed by the first two key bytes
+ * points directly at the nodes of depth 2 and saves two
+ * dependent loads per lookup. costs a fixed 512 KiB.
+ */
+void judy_accelerate(judy_t *judy);
+
+/**
+ * enables a negative lookup filter for this judy array.
+ * a blocked Bloom filter of `bits` bits per key lets judy_lookup
+ * reject most missing keys after a single cache line instead of
+ * descending the tree, at the price of that line for every hit.
+ * 10 bits per key give about 1% false positives. the filter grows
+ * with the keys and is rebuilt after many removals.
+ */
+void judy_filter(judy_t *judy, int bits);
+
+/**
+ * enables access-frequency-adaptive node selection.
+ * a sample of lookups counts the hits of the nodes near the root.
+ * hot TINY nodes get promoted to direct-indexed TRIE nodes while
+ * they are hot and demoted again once they turn cold. cold TRIE
+ * nodes left with at most 7 children by removals are demoted too,
+ * cold TRIE nodes with more children are kept as they are.
+ * the promotions use at most `budget` extra bytes.
+ *
+ * sampled lookups modify the judy array in this mode.
+ */
+void judy_adaptive(judy_t *judy, size_t budget);
+
+/**
+ * called for every key of a judy array together with its value.
+ * `key` is '\0'-terminated and `len` chars long. `tid` is the
+ * index of the calling worker thread in [0, nthreads).
+ */
+typedef void (*judy_visit_t)(void *ctx, int tid, const uchar *key, size_t len, void *val);
+
+/**
+ * called once per worker thread after all keys have been visited
+ * in order to combine the results of thread `tid`.
+ */
+typedef void (*judy_reduce_t)(void *ctx, int tid);
+
+/**
+ * visits every key of the judy array on `nthreads` threads.
+ * the tree is split into subtree tasks at its fan-out points
+ * which idle threads steal from busy ones. keys are visited in
+ * no particular order and the tree must not be modified meanwhile.
+ */
+void judy_parallel_foreach(judy_t *judy, judy_visit_t fn, void *ctx, int nthreads);
+
+/**
+ * same as judy_parallel_foreach but calls `reduce`
+ * for every thread once all keys have been visited.
+ */
+void judy_parallel_reduce(judy_t *judy, judy_visit_t fn, judy_reduce_t reduce, void *ctx, int nthreads);
+
+/**
+ * walks the whole judy array and fills in `stats`.
+ */
+void judy_stats(judy_t *judy, judy_stats_t *stats);
+
+/**
+ * called for every key evicted from a judy array in cache mode.
+ * `key` is only valid during the call.
+ */
+typedef void (*judy_evict_t)(void *ctx, const uchar *key, void *val);
+
+/**
+ * turns the judy array into a cache whose nodes use at most `limit` bytes.
+ * lookups mark their key as recently used. once an insert exceeds the
+ * limit, keys are sampled at random and the first one which hasn't
+ * been used since it was last sampled is evicted (approximate LRU).
+ * `fn` is called for every evicted key and may be NULL.
+ */
+void judy_cache(judy_t *judy, size_t limit, judy_evict_t fn, void *ctx);
+
+/**
+ * opens the judy array stored in the file at `path` or creates it.
+ * nodes are allocated from the file which is mapped shared, so
+ * opening it again maps it and pages nodes in on demand instead
+ * of rebuilding the tree. values are stored as they are and have
+ * to stay meaningful across processes, e.g. offsets or numbers.
+ *
+ * changes reach the file in place but the file is only consistent
+ * after judy_sync(). judy_delete() syncs and closes the file.
+ * returns false and sets errno on failure.
+ */
+bool judy_open_persistent(judy_t *judy, const char *path);
+
+/**
+ * writes all changes of a persistent judy array back to its file.
+ * returns false and sets errno on failure.
+ */
+bool judy_sync(judy_t *judy);
+
+/**
+ * moves all nodes into a single fresh arena. the top levels are
+ * laid out breadth first and every subtree below depth first so
+ * parents and children mostly share pages. each node is rebuilt
+ * as the smallest type that fits its population.
+ * invalidates all fingers. does nothing for persistent and frozen arrays.
+ */
+void judy_compact(judy_t *judy);
+
+/**
+ * packs the judy array into a single arena for read-mostly use.
+ * every node is cut down to its population: small nodes keep only
+ * their used slots and large ones become a bitmap with a dense
+ * array of children. lookups take a dedicated path which skips
+ * the adaptive and cache modes.
+ * the next modification rebuilds the regular nodes first.
+ * invalidates all fingers. does nothing for persistent arrays and
+ * in cache mode.
+ */
+void judy_freeze(judy_t *judy);
+
+/**
+ * freezes the judy array like judy_freeze and shares identical
+ * subtrees, so the tree becomes a directed acyclic graph. subtrees
+ * are identical if they hold the same suffixes with the same
+ * values, which makes this worthwhile for sets and dictionaries
+ * with few distinct values. lookups are not affected.
+ * the next modification expands the shared subtrees again.
+ */
+void judy_minimize(judy_t *judy);
+
 /**
  * removes a previously insert value from judy.
  * if the key can't be found nothing happens.
+ * nodes which become empty are released.
+ */
+void judy_remove(judy_t *judy, const uchar *key);
+
+/**
+ * removes all keys starting with `prefix` in a single descent.
+ * the subtree below the prefix is detached and released at once
+ * and the node above is shrunk like after a removal.
+ */
+void judy_remove_prefix(judy_t *judy, const uchar *prefix);
+
+/**
+ * A set of keys without values (Judy1).
+ * a key ends by a flag in the node of its last char instead of a
+ * '\0' subexpanse, so keys without a continuation need no node of
+ * their own and a test decodes one level less than a lookup.
+ */
+typedef struct JUDY1
+{
+    uintptr_t root;
+} judy1_t;
+
+void judy1_create(judy1_t *judy);
+void judy1_delete(judy1_t *judy);
+
+/**
+ * adds the '\0'-terminated string key to the set.
+ * returns false if it was already a member.
+ */
+bool judy1_set(judy1_t *judy, const uchar *key);
+
+/**
+ * returns true if the key is a member of the set.
+ */
+bool judy1_test(judy1_t *judy, const uchar *key);
+
+/**
+ * removes the key from the set.
+ * returns false if it wasn't a member.
  */
-// void judy_remove(void *judy, const uchar *key);
+bool judy1_unset(judy1_t *judy, const uchar *key);
 
 #endif // __JUDY_H_
@@ -0,0 +1,235 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Set mode:
+ *
+ * Instead of a value in a '\0' subexpanse below it, the slot of
+ * the last char of a key is marked. A slot without any further
+ * subexpanses holds the END sentinel. Otherwise the node in the
+ * slot carries the mark itself: TINY_END in the mask of a TINY
+ * node or END in the '\0' slot of a TRIE node, which is never
+ * used by a subexpanse in this mode. Leaf buckets aren't used.
+ */
+
+// tagged as LEAF but outside of the pointer bits, so
+// it decodes to NULL like an empty leaf bucket
+#define END ((JP)1 << 63)
+
+/**
+ * returns true if a key ends at the slot holding `node`.
+ */
+static bool _judy1_ends(JP node)
+{
+    switch (typeof(node))
+    {
+    case LEAF:
+        return node == END;
+    case TINY:
+        return ((struct TINY *)decode(node))->mask & TINY_END;
+    case TRIE:
+        return ((struct TRIE *)decode(node))->nodes[0] != 0;
+    default:
+        assert(0);
+    }
+
+    __builtin_unreachable();
+}
+
+static void _judy1_mark(JP node, bool end)
+{
+    switch (typeof(node))
+    {
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        tiny->mask = end ? tiny->mask | TINY_END : tiny->mask & ~TINY_END;
+        break;
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = (struct TRIE *)decode(node);
+
+        trie->nodes[0] = end ? END : (JP)0;
+        break;
+    }
+    default:
+        assert(0);
+    }
+}
+
+void judy1_create(judy1_t *judy)
+{
+    judy->root = (JP)0;
+}
+
+void judy1_delete(judy1_t *judy)
+{
+    _node_release(judy->root);
+
+    judy->root = (JP)0;
+}
+
+bool judy1_test(judy1_t *judy, const uchar *key)
+{
+    JP node = judy->root;
+
+    for (; *key; ++key)
+    {
+        uchar cc = *key;
+
+        bool res;
+        switch (typeof(node))
+        {
+        case LEAF:
+            // set mode doesn't use leaf buckets
+            res = false;
+            break;
+        case TINY:
+            res = _tiny_lookup(&node, cc);
+            break;
+        case TRIE:
+            res = _trie_lookup(&node, cc);
+            break;
+        default:
+            assert(0);
+        }
+
+        if (!res || !node)
+            return false;
+    }
+
+    return _judy1_ends(node);
+}
+
+bool judy1_set(judy1_t *judy, const uchar *key)
+{
+    JP *slot = &judy->root;
+
+    for (; *key; ++key)
+    {
+        // a key ending here gets a node to continue in
+        if (!*slot || *slot == END)
+        {
+            struct TINY *tiny = claim(sizeof(struct TINY));
+
+            if (*slot == END)
+                tiny->mask = TINY_END;
+
+            *slot = encode(tiny, TINY);
+        }
+
+        bool end = _judy1_ends(*slot);
+
+        JP *child = slot;
+
+        switch (typeof(*slot))
+        {
+        case TINY:
+            _tiny_insert(&child, *key);
+            break;
+        case TRIE:
+            _trie_insert(&child, *key);
+            break;
+        }
+
+        // the mask of a full TINY node doesn't survive its promotion
+        if (end && typeof(*slot) == TRIE)
+            _judy1_mark(*slot, true);
+
+        slot = child;
+    }
+
+    if (!*slot)
+    {
+        *slot = END;
+        return true;
+    }
+
+    if (_judy1_ends(*slot))
+        return false;
+
+    _judy1_mark(*slot, true);
+
+    return true;
+}
+
+/**
+ * removes the subexpanse of `cc` from the node in `slot`
+ * without losing the mark of the node.
+ */
+static void _judy1_erase(JP *slot, uchar cc)
+{
+    bool end = _judy1_ends(*slot);
+
+    // an unmarked node can be demoted or released as usual
+    _judy1_mark(*slot, false);
+
+    _node_erase(slot, cc);
+
+    if (!end)
+        return;
+
+    if (*slot)
+        _judy1_mark(*slot, true);
+    else
+        *slot = END;
+}
+
+/**
+ * removes the rest of `key` below the slot `slot`.
+ * returns false if the key isn't a member.
+ */
+static bool _judy1_unset(JP *slot, const uchar *key)
+{
+    if (!*key)
+    {
+        if (!_judy1_ends(*slot))
+            return false;
+
+        if (*slot == END)
+        {
+            *slot = (JP)0;
+            return true;
+        }
+
+        _judy1_mark(*slot, false);
+
+        if (!_node_count(*slot))
+        {
+            stash((void *)decode(*slot), _node_size(*slot));
+
+            *slot = (JP)0;
+        }
+
+        return true;
+    }
+
+    JP *child = _node_find(*slot, *key);
+
+    if (!child || !*child)
+        return false;
+
+    if (!_judy1_unset(child, key + 1))
+        return false;
+
+    if (!*child)
+        _judy1_erase(slot, *key);
+
+    return true;
+}
+
+bool judy1_unset(judy1_t *judy, const uchar *key)
+{
+    return _judy1_unset(&judy->root, key);
+}
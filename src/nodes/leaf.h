@@ -1,14 +1,516 @@
 #ifndef __LEAF_H_
 #define __LEAF_H_
 
-static bool _leaf_lookup(JP *node, uchar cc)
+#include <string.h>
+
+#define SIMDE_ENABLE_NATIVE_ALIASES
+#ifdef __SSE__
+#include <simde/x86/sse2.h>
+// #include <emmintrin.h>
+#elif __ARM_NEON
+#include <simde/arm/neon.h>
+// #include <arm_neon.h>
+#else
+#error requires x86-64 sse or ARM neon
+#endif
+
+/**
+ * This node stores the remaining suffixes of up to LEAF_SLOTS keys
+ * together with their values in 1, 2 or 4 consecutive cache lines.
+ *
+ * The suffixes are '\0'-terminated, sorted and packed one after
+ * another in `data`. `heads` holds the first char of every suffix
+ * (which is '\0' for a key ending at the bucket) and is compared
+ * with SIMD to find the candidates. The values grow down from the
+ * end of the bucket, the value of suffix `i` is `_leaf_vals()[-i]`.
+ *
+ * A bucket takes the place of a whole subtree, so it is searched
+ * for the rest of the key at once instead of char by char. Once a
+ * suffix doesn't fit anymore the bucket bursts into an inner node
+ * with one bucket per first char below.
+ *
+ * A single suffix too long for LEAF_LINES gets a bucket of its own
+ * of LEAF_RECORD lines, a plain key/value record, instead of an
+ * inner node per char if it is longer than 64 * LEAF_LINES. The next
+ * suffix bursts the record. So a tree of a few keys is a single
+ * bucket at the root unless they are longer than a record.
+ *
+ * Buckets of fixed-length keys (see fixed.c) store suffixes of
+ * `width` bytes without a terminator. Such buckets are handled by
+ * the _n variants, which take the width of the suffixes.
+ *
+ * A LEAF tagged JP which decodes to NULL is an empty subexpanse.
+ */
+#define LEAF_SLOTS 16
+#define LEAF_LINES 4
+#define LEAF_RECORD 32
+
+struct LEAF
+{
+    uchar heads[LEAF_SLOTS];
+
+    uint8_t count;
+
+    // size of the bucket in cache lines
+    uint8_t lines;
+
+    // chars of `data` used by suffixes
+    uint16_t used;
+
+    uchar data[];
+};
+
+static inline size_t _leaf_size(struct LEAF *leaf)
+{
+    return 64 * leaf->lines;
+}
+
+static inline JP *_leaf_vals(struct LEAF *leaf)
+{
+    return (JP *)((uchar *)leaf + _leaf_size(leaf)) - 1;
+}
+
+/**
+ * the fewest cache lines that fit `count` suffixes of `used` chars or 0.
+ */
+static inline int _leaf_lines(int count, size_t used)
+{
+    size_t need = offsetof(struct LEAF, data) + used + count * sizeof(JP);
+
+    if (count > LEAF_SLOTS)
+        return 0;
+
+    for (int lines = 1; lines <= LEAF_LINES; lines *= 2)
+        if (need <= 64 * (size_t)lines)
+            return lines;
+
+    if (count == 1 && need <= 64 * LEAF_RECORD)
+        return LEAF_RECORD;
+
+    return 0;
+}
+
+/**
+ * returns the index of the first suffix starting with `cc` or -1.
+ */
+static inline __attribute__((always_inline)) int _leaf_first(struct LEAF *leaf, uchar cc)
+{
+#ifdef __SSE__
+
+    __m128i vec = _mm_loadu_si128((__m128i *)leaf->heads);
+    __m128i key = _mm_set1_epi8(cc);
+    __m128i cmp = _mm_cmpeq_epi8(vec, key);
+
+    uint32_t res = _mm_movemask_epi8(cmp) & ((1u << leaf->count) - 1);
+
+    return res ? __builtin_ctz(res) : -1;
+
+#elif __ARM_NEON
+
+    uint8x16_t vec = vld1q_u8(leaf->heads);
+    uint8x16_t key = vdupq_n_u8(cc);
+    uint8x16_t cmp = vceqq_u8(vec, key);
+
+    // 4 bits per lane
+    uint8x8_t nib = vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4);
+
+    uint64_t res = vget_lane_u64(vreinterpret_u64_u8(nib), 0);
+
+    if (leaf->count < LEAF_SLOTS)
+        res &= (1ull << (4 * leaf->count)) - 1;
+
+    return res ? __builtin_ctzll(res) >> 2 : -1;
+
+#endif
+}
+
+/**
+ * the bytes of the suffix at `pos` including its terminator.
+ */
+static inline size_t _leaf_len(const uchar *pos, size_t width)
+{
+    return width ? width : strlen((char *)pos) + 1;
+}
+
+static inline int _leaf_cmp(const uchar *pos, const uchar *key, size_t width)
+{
+    return width ? memcmp(pos, key, width) : strcmp((char *)pos, (char *)key);
+}
+
+/**
+ * the suffix with index `i`.
+ */
+static inline uchar *_leaf_suffix(struct LEAF *leaf, int i, size_t width)
+{
+    uchar *pos = leaf->data;
+
+    if (width)
+        return pos + i * width;
+
+    while (i--)
+        pos += strlen((char *)pos) + 1;
+
+    return pos;
+}
+
+/**
+ * the slot of the value of the suffix `key` in `node` or NULL.
+ */
+static inline __attribute__((always_inline)) JP *_leaf_find_n(JP node, const uchar *key, size_t width)
+{
+    struct LEAF *leaf = (struct LEAF *)decode(node);
+
+    if (!leaf)
+        return NULL;
+
+    int i = _leaf_first(leaf, key[0]);
+
+    if (i < 0)
+        return NULL;
+
+    uchar *pos = _leaf_suffix(leaf, i, width);
+
+    for (; i < leaf->count && leaf->heads[i] == key[0]; ++i)
+    {
+        int cmp = _leaf_cmp(pos, key, width);
+
+        if (!cmp)
+            return &_leaf_vals(leaf)[-i];
+
+        if (cmp > 0)
+            break;
+
+        pos += _leaf_len(pos, width);
+    }
+
+    return NULL;
+}
+
+static inline JP *_leaf_find(JP node, const uchar *key)
+{
+    return _leaf_find_n(node, key, 0);
+}
+
+static inline bool _leaf_lookup(JP *node, const uchar *key)
+{
+    JP *slot = _leaf_find(*node, key);
+
+    if (!slot)
+        return false;
+
+    *node = *slot;
+
+    return true;
+}
+
+/**
+ * copies the bucket `leaf` into the zeroed memory `mem` of `lines` cache lines.
+ */
+static inline struct LEAF *_leaf_copy(void *mem, struct LEAF *leaf, int lines)
+{
+    struct LEAF *copy = mem;
+
+    memcpy(copy, leaf, offsetof(struct LEAF, data) + leaf->used);
+
+    copy->lines = lines;
+
+    JP *from = _leaf_vals(leaf);
+    JP *to = _leaf_vals(copy);
+
+    for (int i = 0; i < leaf->count; ++i)
+        to[-i] = from[-i];
+
+    return copy;
+}
+
+/**
+ * moves the bucket in `slot` into a bucket of `lines` cache lines.
+ */
+static inline struct LEAF *_leaf_resize(JP *slot, int lines)
+{
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+    struct LEAF *copy = _leaf_copy(claim(64 * lines), leaf, lines);
+
+    stash(leaf, _leaf_size(leaf));
+
+    *slot = encode(copy, LEAF);
+
+    return copy;
+}
+
+/**
+ * adds the suffix `key` to the bucket in `**nodeptr`, which may be empty.
+ * on success `*nodeptr` points to the slot of its value, which is empty
+ * for a new suffix. returns false if the suffix doesn't fit.
+ */
+static inline bool _leaf_insert_n(JP **nodeptr, const uchar *key, size_t width)
+{
+    JP *slot = *nodeptr;
+
+    JP *val = _leaf_find_n(*slot, key, width);
+
+    if (val)
+    {
+        *nodeptr = val;
+        return true;
+    }
+
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+
+    int count = leaf ? leaf->count : 0;
+    size_t used = leaf ? leaf->used : 0;
+    size_t len = _leaf_len(key, width);
+
+    int lines = _leaf_lines(count + 1, used + len);
+
+    // a shorter suffix saves fewer inner nodes of 64 bytes
+    // each than the record takes on top of a bucket
+    if (!lines || (lines == LEAF_RECORD && len <= 64 * LEAF_LINES))
+        return false;
+
+    if (!leaf)
+    {
+        leaf = claim(64 * lines);
+        leaf->lines = lines;
+
+        *slot = encode(leaf, LEAF);
+    }
+    else if (lines > leaf->lines)
+    {
+        leaf = _leaf_resize(slot, lines);
+    }
+
+    int i = 0;
+    uchar *pos = leaf->data;
+
+    for (; i < count && _leaf_cmp(pos, key, width) < 0; ++i)
+        pos += _leaf_len(pos, width);
+
+    JP *vals = _leaf_vals(leaf);
+
+    memmove(pos + len, pos, leaf->data + used - pos);
+    memcpy(pos, key, len);
+
+    memmove(&leaf->heads[i + 1], &leaf->heads[i], count - i);
+    leaf->heads[i] = key[0];
+
+    memmove(&vals[-count], &vals[-count + 1], (count - i) * sizeof(JP));
+    vals[-i] = (JP)0;
+
+    leaf->count = count + 1;
+    leaf->used = used + len;
+
+    *nodeptr = &vals[-i];
+
+    return true;
+}
+
+static inline bool _leaf_insert(JP **nodeptr, const uchar *key)
+{
+    return _leaf_insert_n(nodeptr, key, 0);
+}
+
+/**
+ * removes the suffixes with the indices `i` up to `j` from the bucket
+ * in `slot`, which span the data from `from` to `to`.
+ * an empty bucket is stashed and a sparse one shrunk.
+ */
+static inline void _leaf_erase(JP *slot, int i, int j, uchar *from, uchar *to)
+{
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+
+    JP *vals = _leaf_vals(leaf);
+
+    int count = leaf->count;
+    int m = j - i;
+
+    memmove(from, to, leaf->data + leaf->used - to);
+    memmove(&leaf->heads[i], &leaf->heads[j], count - j);
+    memmove(&vals[-count + 1 + m], &vals[-count + 1], (count - j) * sizeof(JP));
+
+    leaf->count = count - m;
+    leaf->used -= to - from;
+
+    if (!leaf->count)
+    {
+        stash(leaf, _leaf_size(leaf));
+
+        *slot = (JP)0;
+        return;
+    }
+
+    int lines = _leaf_lines(leaf->count, leaf->used);
+
+    if (lines < leaf->lines)
+        _leaf_resize(slot, lines);
+}
+
+/**
+ * removes the suffix `key` from the bucket in `slot`.
+ * returns false if the suffix can't be found.
+ */
+static inline bool _leaf_remove(JP *slot, const uchar *key)
+{
+    JP *val = _leaf_find(*slot, key);
+
+    if (!val)
+        return false;
+
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+
+    int i = _leaf_vals(leaf) - val;
+
+    uchar *pos = _leaf_suffix(leaf, i, 0);
+
+    _leaf_erase(slot, i, i + 1, pos, pos + strlen((char *)pos) + 1);
+
+    return true;
+}
+
+/**
+ * removes all suffixes starting with the non-empty `prefix`
+ * from the bucket in `slot`. they form a single run since the
+ * suffixes are sorted. returns false if there are none.
+ */
+static inline bool _leaf_remove_prefix(JP *slot, const uchar *prefix)
 {
-    return false;
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+
+    if (!leaf)
+        return false;
+
+    size_t len = strlen((char *)prefix);
+
+    int i = 0;
+    uchar *from = leaf->data;
+
+    for (; i < leaf->count && strncmp((char *)from, (char *)prefix, len) < 0; ++i)
+        from += strlen((char *)from) + 1;
+
+    int j = i;
+    uchar *to = from;
+
+    for (; j < leaf->count && !strncmp((char *)to, (char *)prefix, len); ++j)
+        to += strlen((char *)to) + 1;
+
+    if (i == j)
+        return false;
+
+    _leaf_erase(slot, i, j, from, to);
+
+    return true;
+}
+
+/**
+ * builds a bucket of the `n` sorted suffixes in `keys` and their values.
+ */
+static inline JP _leaf_make(uchar **keys, const JP *vals, int n, size_t width)
+{
+    size_t used = 0;
+
+    for (int i = 0; i < n; ++i)
+        used += _leaf_len(keys[i], width);
+
+    int lines = _leaf_lines(n, used);
+
+    assert(lines);
+
+    struct LEAF *leaf = claim(64 * lines);
+
+    leaf->count = n;
+    leaf->lines = lines;
+    leaf->used = used;
+
+    uchar *pos = leaf->data;
+
+    for (int i = 0; i < n; ++i)
+    {
+        size_t len = _leaf_len(keys[i], width);
+
+        memcpy(pos, keys[i], len);
+        pos += len;
+
+        leaf->heads[i] = keys[i][0];
+        _leaf_vals(leaf)[-i] = vals[i];
+    }
+
+    return encode(leaf, LEAF);
+}
+
+/**
+ * replaces the bucket in `slot` by an inner node with the first
+ * chars of its suffixes as subexpanses. the rest of every suffix
+ * moves into a bucket below, the value of the empty suffix into
+ * the '\0' subexpanse. suffixes of fixed-length keys which are
+ * only a single byte long leave their value in the subexpanse.
+ */
+static inline void _leaf_burst_n(JP *slot, size_t width)
+{
+    struct LEAF *leaf = (struct LEAF *)decode(*slot);
+
+    JP *vals = _leaf_vals(leaf);
+
+    uchar heads[LEAF_SLOTS];
+    JP nodes[LEAF_SLOTS];
+    int n = 0;
+
+    uchar *pos = leaf->data;
+
+    for (int i = 0; i < leaf->count;)
+    {
+        uchar cc = leaf->heads[i];
+
+        uchar *keys[LEAF_SLOTS];
+        JP group[LEAF_SLOTS];
+        int m = 0;
+
+        // suffixes with the same first char are adjacent
+        for (; i < leaf->count && leaf->heads[i] == cc; ++i, ++m)
+        {
+            keys[m] = pos + 1;
+            group[m] = vals[-i];
+
+            pos += _leaf_len(pos, width);
+        }
+
+        bool value = width ? width == 1 : !cc;
+
+        heads[n] = cc;
+        nodes[n] = value ? group[0] : _leaf_make(keys, group, m, width ? width - 1 : 0);
+        ++n;
+    }
+
+    if (n <= 7)
+    {
+        struct TINY *tiny = claim(sizeof(struct TINY));
+
+        for (int i = 0; i < n; ++i)
+        {
+            tiny->keys[i] = heads[i];
+            tiny->nodes[i] = nodes[i];
+            tiny->mask |= 0x80 >> i;
+        }
+
+        *slot = encode(tiny, TINY);
+    }
+    else
+    {
+        struct TRIE *trie = claim(sizeof(struct TRIE));
+
+        for (int i = 0; i < n; ++i)
+            trie->nodes[heads[i]] = nodes[i];
+
+        *slot = encode(trie, TRIE);
+    }
+
+    stash(leaf, _leaf_size(leaf));
+
+    COUNT(bursts);
 }
 
-static bool _leaf_insert(JP **nodeptr, uchar cc)
+static inline void _leaf_burst(JP *slot)
 {
-    return false;
+    _leaf_burst_n(slot, 0);
 }
 
 #endif //  __LEAF_H_
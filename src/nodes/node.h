@@ -0,0 +1,390 @@
+#ifndef __NODE_H_
+#define __NODE_H_
+
+/**
+ * Generic helpers on top of the node interface.
+ * Used by whole-tree passes which don't care about the
+ * layout of a particular node type.
+ *
+ * requires nodes/trie.h, nodes/tiny.h, nodes/leaf.h, nodes/packed.h
+ * and nodes/stride.h.
+ */
+
+/**
+ * the slot of `cc` in `node` or NULL.
+ * leaf buckets have no subexpanses of single chars,
+ * they are searched for the rest of the key by _leaf_find().
+ */
+static inline JP *_node_find(JP node, uchar cc)
+{
+    switch (typeof(node))
+    {
+    case LEAF:
+        return NULL;
+    case TINY:
+        return _tiny_find(node, cc);
+    case TRIE:
+        return _trie_find(node, cc);
+    case PACKED:
+        return _packed_find(node, cc);
+    case STRIDE:
+        return _node_find(_stride_base(node), cc);
+    default:
+        assert(0);
+    }
+
+    __builtin_unreachable();
+}
+
+/**
+ * size in bytes of `node` itself.
+ */
+static inline size_t _node_size(JP node)
+{
+    switch (typeof(node))
+    {
+    case LEAF:
+        return decode(node) ? _leaf_size((struct LEAF *)decode(node)) : 0;
+    case TINY:
+        return sizeof(struct TINY);
+    case TRIE:
+        return sizeof(struct TRIE);
+    case PACKED:
+        return _packed_size(((struct PACKED *)decode(node))->count);
+    case STRIDE:
+        return _stride_bytes(node) + _node_size(_stride_base(node));
+    default:
+        return 0;
+    }
+}
+
+/**
+ * collects the used subexpanses of `node` in ascending order of their chars.
+ * the subexpanse of '\0' holds a value instead of a node.
+ * returns the number of subexpanses, which is 0 for leaf buckets.
+ */
+static inline int _node_children(JP node, uchar *keys, JP **slots)
+{
+    int n = 0;
+
+    switch (typeof(node))
+    {
+    case STRIDE:
+        return _node_children(_stride_base(node), keys, slots);
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        for (int i = 0; i < 7; ++i)
+        {
+            if (!(tiny->mask & (0x80 >> i)))
+                continue;
+
+            // insertion sort, there are at most 7 chars
+            int j = n++;
+
+            for (; j > 0 && keys[j - 1] > tiny->keys[i]; --j)
+            {
+                keys[j] = keys[j - 1];
+                slots[j] = slots[j - 1];
+            }
+
+            keys[j] = tiny->keys[i];
+            slots[j] = &tiny->nodes[i];
+        }
+
+        break;
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = (struct TRIE *)decode(node);
+
+        for (int i = 0; i < 256; ++i)
+        {
+            if (!trie->nodes[i])
+                continue;
+
+            keys[n] = i;
+            slots[n] = &trie->nodes[i];
+            ++n;
+        }
+
+        break;
+    }
+    case PACKED:
+    {
+        struct PACKED *packed = (struct PACKED *)decode(node);
+
+        for (int i = 0; i < 256; ++i)
+        {
+            if (!(packed->bits[i >> 6] & (1ull << (i & 63))))
+                continue;
+
+            keys[n] = i;
+            slots[n] = &packed->nodes[n];
+            ++n;
+        }
+
+        break;
+    }
+    }
+
+    return n;
+}
+
+/**
+ * number of used subexpanses of `node`.
+ */
+static inline int _node_count(JP node)
+{
+    switch (typeof(node))
+    {
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        return __builtin_popcount(tiny->mask);
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = (struct TRIE *)decode(node);
+
+        int n = 0;
+
+        for (int i = 0; i < 256; ++i)
+            n += trie->nodes[i] != 0;
+
+        return n;
+    }
+    case PACKED:
+        return ((struct PACKED *)decode(node))->count;
+    case STRIDE:
+        return _node_count(_stride_base(node));
+    default:
+        return 0;
+    }
+}
+
+/**
+ * iterates over the used subexpanses of `node` in no particular order.
+ * `*pos` has to start at 0. returns the next slot and its char
+ * or NULL once all subexpanses have been visited.
+ */
+static inline JP *_node_next(JP node, int *pos, uchar *cc)
+{
+    switch (typeof(node))
+    {
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        for (; *pos < 7; ++*pos)
+        {
+            if (tiny->mask & (0x80 >> *pos))
+            {
+                *cc = tiny->keys[*pos];
+                return &tiny->nodes[(*pos)++];
+            }
+        }
+
+        return NULL;
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = (struct TRIE *)decode(node);
+
+        for (; *pos < 256; ++*pos)
+        {
+            if (trie->nodes[*pos])
+            {
+                *cc = *pos;
+                return &trie->nodes[(*pos)++];
+            }
+        }
+
+        return NULL;
+    }
+    case PACKED:
+    {
+        struct PACKED *packed = (struct PACKED *)decode(node);
+
+        for (; *pos < 256; ++*pos)
+        {
+            if (packed->bits[*pos >> 6] & (1ull << (*pos & 63)))
+            {
+                *cc = *pos;
+                return _packed_find(node, (*pos)++);
+            }
+        }
+
+        return NULL;
+    }
+    case STRIDE:
+        return _node_next(_stride_base(node), pos, cc);
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * the smallest node type that fits `n` subexpanses.
+ */
+static inline int _node_type(int n)
+{
+    return n <= 7 ? TINY : TRIE;
+}
+
+static inline size_t _node_type_size(int type)
+{
+    return type == TINY ? sizeof(struct TINY) : sizeof(struct TRIE);
+}
+
+/**
+ * builds a node of `type` into the zeroed memory `mem`.
+ */
+static inline JP _node_make(void *mem, int type, const uchar *keys, const JP *nodes, int n)
+{
+    switch (type)
+    {
+    case TINY:
+    {
+        struct TINY *tiny = mem;
+
+        assert(n <= 7);
+
+        for (int i = 0; i < n; ++i)
+        {
+            tiny->keys[i] = keys[i];
+            tiny->nodes[i] = nodes[i];
+            tiny->mask |= 0x80 >> i;
+        }
+
+        break;
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = mem;
+
+        for (int i = 0; i < n; ++i)
+            trie->nodes[keys[i]] = nodes[i];
+
+        break;
+    }
+    default:
+        assert(0);
+    }
+
+    return encode(mem, type);
+}
+
+/**
+ * TRIE nodes which drop to this many subexpanses become TINY nodes.
+ * lower than the 8 subexpanses of a promotion so that a node at the
+ * border doesn't flip between both types.
+ */
+#define NODE_DEMOTE 4
+
+/**
+ * removes the subexpanse of `cc` from the node in `slot`.
+ * the subexpanse has to be empty already. an empty node is
+ * stashed and a sparse node is replaced by a smaller one.
+ */
+static inline void _node_erase(JP *slot, uchar cc)
+{
+    JP node = *slot;
+
+    JP *child = _node_find(node, cc);
+
+    assert(child);
+
+    *child = (JP)0;
+
+    switch (typeof(node))
+    {
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        tiny->mask &= ~(0x80 >> (child - tiny->nodes));
+
+        if (tiny->mask)
+            return;
+
+        break;
+    }
+    case TRIE:
+    {
+        uchar keys[256];
+        JP *slots[256];
+        JP nodes[256];
+
+        int n = _node_children(node, keys, slots);
+
+        if (n > NODE_DEMOTE)
+            return;
+
+        if (n)
+        {
+            for (int i = 0; i < n; ++i)
+                nodes[i] = *slots[i];
+
+            *slot = _node_make(claim(sizeof(struct TINY)), TINY, keys, nodes, n);
+
+            stash((void *)decode(node), _node_size(node));
+
+            COUNT(demotions);
+            return;
+        }
+
+        break;
+    }
+    }
+
+    stash((void *)decode(node), _node_size(node));
+
+    *slot = (JP)0;
+}
+
+/**
+ * stashes `node` and all nodes below it.
+ */
+static inline void _node_release(JP node)
+{
+    switch (typeof(node))
+    {
+    case TINY:
+    {
+        struct TINY *tiny = (struct TINY *)decode(node);
+
+        for (int i = 0; i < 7; ++i)
+            if ((tiny->mask & (0x80 >> i)) && tiny->keys[i])
+                _node_release(tiny->nodes[i]);
+
+        break;
+    }
+    case TRIE:
+    {
+        struct TRIE *trie = (struct TRIE *)decode(node);
+
+        for (int i = 1; i < 256; ++i)
+            if (trie->nodes[i])
+                _node_release(trie->nodes[i]);
+
+        break;
+    }
+    case LEAF:
+        if (!decode(node))
+            return;
+        break;
+    case STRIDE:
+        _node_release(_stride_base(node));
+        _stride_free(node);
+        return;
+    default:
+        return;
+    }
+
+    stash((void *)decode(node), _node_size(node));
+}
+
+#endif // __NODE_H_
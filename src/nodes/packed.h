@@ -0,0 +1,75 @@
+#ifndef __PACKED_H_
+#define __PACKED_H_
+
+/**
+ * This node only exists in frozen judy arrays, see freeze.c.
+ *
+ * A bitmap marks the used subexpanses and their nodes are
+ * stored densely in ascending order of their chars, so a node
+ * takes 40 bytes plus one JP per subexpanse. The slot of a char
+ * is the number of used chars below it, which is the rank of
+ * its bitmap word plus a popcount within that word.
+ */
+struct PACKED
+{
+    uint64_t bits[4];
+
+    // used subexpanses before each word of the bitmap
+    uint8_t rank[4];
+    uint16_t count;
+
+    JP nodes[];
+};
+
+static inline __attribute__((always_inline)) JP *_packed_find(JP node, uchar cc)
+{
+    struct PACKED *packed = (struct PACKED *)decode(node);
+
+    uint64_t word = packed->bits[cc >> 6];
+    uint64_t bit = 1ull << (cc & 63);
+
+    if (!(word & bit))
+        return NULL;
+
+    return &packed->nodes[packed->rank[cc >> 6] + __builtin_popcountll(word & (bit - 1))];
+}
+
+static inline bool _packed_lookup(JP *node, uchar cc)
+{
+    JP *slot = _packed_find(*node, cc);
+
+    if (!slot)
+        return false;
+
+    *node = *slot;
+
+    return true;
+}
+
+static inline size_t _packed_size(int n)
+{
+    return sizeof(struct PACKED) + n * sizeof(JP);
+}
+
+/**
+ * builds a node of the `n` ascending `keys` into the zeroed memory `mem`.
+ */
+static inline JP _packed_make(void *mem, const uchar *keys, const JP *nodes, int n)
+{
+    struct PACKED *packed = mem;
+
+    for (int i = 0; i < n; ++i)
+    {
+        packed->bits[keys[i] >> 6] |= 1ull << (keys[i] & 63);
+        packed->nodes[i] = nodes[i];
+    }
+
+    for (int i = 1; i < 4; ++i)
+        packed->rank[i] = packed->rank[i - 1] + __builtin_popcountll(packed->bits[i - 1]);
+
+    packed->count = n;
+
+    return encode(mem, PACKED);
+}
+
+#endif // __PACKED_H_
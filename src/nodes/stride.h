@@ -0,0 +1,121 @@
+#ifndef __STRIDE_H_
+#define __STRIDE_H_
+
+/**
+ * A stride node decodes two chars at once below a node whose next
+ * two levels are densely populated. Both chars are taken from one
+ * alphabet of `size` chars, the slot of a pair is its index in a
+ * direct table of `size * size` slots, which mirrors the nodes two
+ * levels below.
+ *
+ * It wraps the regular node of the first char. Keys with a char
+ * outside the alphabet, including keys ending in between, continue
+ * at that node one char at a time, and so does everything besides
+ * lookups and inserts: the generic helpers in node.h only see the
+ * wrapped node.
+ *
+ * In frozen arrays the table directly follows the node, see freeze.c.
+ * Mutable arrays claim the node and its table separately and keep
+ * the table in line with the wrapped node, see stride.c.
+ */
+struct STRIDE
+{
+    JP node;
+    JP *nodes;
+
+    uint64_t bits[4];
+
+    // chars of the alphabet before each word of the bitmap
+    uint8_t rank[4];
+    uint16_t size;
+
+    // whether the node and its table were claimed, i.e. not frozen
+    bool claimed;
+};
+
+/**
+ * alphabets of at most STRIDE_ALPHABET chars are decoded by frozen
+ * stride nodes if at least half of the pairs and STRIDE_MIN pairs
+ * are used. the table of a mutable stride node is claimed from the
+ * largest size class, which holds the pairs of STRIDE_TABLE chars.
+ */
+#define STRIDE_ALPHABET 32
+#define STRIDE_TABLE 16
+#define STRIDE_MIN 64
+
+// size classes of a mutable stride node and its table
+#define STRIDE_NODE 64
+#define STRIDE_NODES (STRIDE_TABLE * STRIDE_TABLE * sizeof(JP))
+
+static inline JP _stride_base(JP node)
+{
+    return ((struct STRIDE *)decode(node))->node;
+}
+
+/**
+ * index of `cc` in the alphabet or -1.
+ */
+static inline __attribute__((always_inline)) int _stride_rank(struct STRIDE *stride, uchar cc)
+{
+    uint64_t word = stride->bits[cc >> 6];
+    uint64_t bit = 1ull << (cc & 63);
+
+    if (!(word & bit))
+        return -1;
+
+    return stride->rank[cc >> 6] + __builtin_popcountll(word & (bit - 1));
+}
+
+/**
+ * the slot of the first two chars of `key` or NULL
+ * if they have to be decoded by the wrapped node.
+ */
+static inline __attribute__((always_inline)) JP *_stride_find(JP node, const uchar *key)
+{
+    struct STRIDE *stride = (struct STRIDE *)decode(node);
+
+    int r0 = _stride_rank(stride, key[0]);
+
+    if (r0 < 0)
+        return NULL;
+
+    int r1 = _stride_rank(stride, key[1]);
+
+    if (r1 < 0)
+        return NULL;
+
+    return &stride->nodes[r0 * stride->size + r1];
+}
+
+/**
+ * size of a frozen stride node with an alphabet of `size` chars.
+ */
+static inline size_t _stride_size(int size)
+{
+    return sizeof(struct STRIDE) + size * size * sizeof(JP);
+}
+
+/**
+ * size of the stride node `node` itself, without the wrapped node.
+ */
+static inline size_t _stride_bytes(JP node)
+{
+    struct STRIDE *stride = (struct STRIDE *)decode(node);
+
+    return stride->claimed ? STRIDE_NODE + STRIDE_NODES : _stride_size(stride->size);
+}
+
+/**
+ * stashes the mutable stride node `node` but not the wrapped node.
+ */
+static inline void _stride_free(JP node)
+{
+    struct STRIDE *stride = (struct STRIDE *)decode(node);
+
+    assert(stride->claimed);
+
+    stash(stride->nodes, STRIDE_NODES);
+    stash(stride, STRIDE_NODE);
+}
+
+#endif // __STRIDE_H_
@@ -13,6 +13,19 @@
 #error requires x86-64 sse or ARM neon
 #endif
 
+/**
+ * This node stores up to 7 subexpanses in a single cache line.
+ *
+ * Slot `i` is marked used by bit `0x80 >> i` in the mask.
+ * The keys are compared big-endian so that `keys[0]` lands
+ * in the most significant lane; the mask itself ends up in
+ * the lowest lane which is never set in the mask.
+ *
+ * The lowest mask bit doesn't belong to a slot. Set mode uses
+ * it to mark that a key ends at this node, see judy1.c.
+ */
+#define TINY_END 0x01
+
 struct TINY
 {
     uchar keys[7];
@@ -20,21 +33,22 @@ struct TINY
     JP nodes[7];
 };
 
-static bool _tiny_lookup(JP *node, uchar cc)
+/**
+ * returns the mask bit of the slot holding `cc` or 0.
+ */
+static inline __attribute__((always_inline)) uint64_t _tiny_match(struct TINY *tiny, uchar cc)
 {
-    struct TINY *tiny = (struct TINY *)decode(*node);
-
 #ifdef __SSE__
 
-    __m64 vec = _m_from_int64(*(uint64_t *)&tiny->keys);
+    __m64 vec = _m_from_int64(__builtin_bswap64(*(uint64_t *)&tiny->keys));
     __m64 key = _mm_set1_pi8(cc);
     __m64 cmp = _mm_cmpeq_pi8(vec, key);
 
-    uint64_t res = _mm_movemask_pi8(cmp) & tiny->mask;
+    uint64_t res = _mm_movemask_pi8(cmp) & tiny->mask & ~TINY_END;
 
 #elif __ARM_NEON
 
-    uint8x8_t vec = vcreate_u8(*(uint64_t *)&tiny->keys);
+    uint8x8_t vec = vcreate_u8(__builtin_bswap64(*(uint64_t *)&tiny->keys));
     int8x8_t msk = vcreate_s8(0x00fffefdfcfbfa08ull);
 
     uint8x8_t tmp = vdup_n_u8(0x80);
@@ -45,10 +59,19 @@ static bool _tiny_lookup(JP *node, uchar cc)
 
     uint8x8_t mov = vshl_u8(msb, msk);
 
-    uint64_t res = vaddv_u8(mov) & tiny->mask;
+    uint64_t res = vaddv_u8(mov) & tiny->mask & ~TINY_END;
 
 #endif
 
+    return res;
+}
+
+static inline bool _tiny_lookup(JP *node, uchar cc)
+{
+    struct TINY *tiny = (struct TINY *)decode(*node);
+
+    uint64_t res = _tiny_match(tiny, cc);
+
     if (!res)
         return false;
 
@@ -59,34 +82,23 @@ static bool _tiny_lookup(JP *node, uchar cc)
     return true;
 }
 
-static bool _tiny_insert(JP **nodeptr, uchar cc)
+static inline JP *_tiny_find(JP node, uchar cc)
 {
-    struct TINY *tiny = (struct TINY *)decode(**nodeptr);
-
-#ifdef __SSE__
+    struct TINY *tiny = (struct TINY *)decode(node);
 
-    __m64 vec = _m_from_int64(*(uint64_t *)&tiny->keys);
-    __m64 key = _mm_set1_pi8(cc);
-    __m64 cmp = _mm_cmpeq_pi8(vec, key);
+    uint64_t res = _tiny_match(tiny, cc);
 
-    uint64_t res = _mm_movemask_pi8(cmp) & tiny->mask;
-
-#elif __ARM_NEON
-
-    uint8x8_t vec = vcreate_u8(*(uint64_t *)&tiny->keys);
-    int8x8_t msk = vcreate_s8(0x00fffefdfcfbfa08ull);
-
-    uint8x8_t tmp = vdup_n_u8(0x80);
-    uint8x8_t key = vdup_n_u8(cc);
-
-    uint8x8_t cmp = vceq_u8(vec, key);
-    uint8x8_t msb = vand_u8(cmp, tmp);
+    if (!res)
+        return NULL;
 
-    uint8x8_t mov = vshl_u8(msb, msk);
+    return &tiny->nodes[__builtin_clz(res << 24)];
+}
 
-    uint64_t res = vaddv_u8(mov) & tiny->mask;
+static inline bool _tiny_insert(JP **nodeptr, uchar cc)
+{
+    struct TINY *tiny = (struct TINY *)decode(**nodeptr);
 
-#endif
+    uint64_t res = _tiny_match(tiny, cc);
 
     if (res)
     {
@@ -94,7 +106,7 @@ static bool _tiny_insert(JP **nodeptr, uchar cc)
         return true;
     }
 
-    if (tiny->mask != 0xfe)
+    if ((tiny->mask | TINY_END) != 0xff)
     {
         uint64_t idx = __builtin_clz(~((uint32_t)tiny->mask << 24));
 
@@ -107,18 +119,20 @@ static bool _tiny_insert(JP **nodeptr, uchar cc)
     {
         struct TRIE *trie = claim(sizeof(struct TRIE));
 
-        trie->nodes[tiny->nodes[0]] = tiny->nodes[0];
-        trie->nodes[tiny->nodes[1]] = tiny->nodes[1];
-        trie->nodes[tiny->nodes[2]] = tiny->nodes[2];
-        trie->nodes[tiny->nodes[3]] = tiny->nodes[3];
-        trie->nodes[tiny->nodes[4]] = tiny->nodes[4];
-        trie->nodes[tiny->nodes[5]] = tiny->nodes[5];
-        trie->nodes[tiny->nodes[6]] = tiny->nodes[6];
+        trie->nodes[tiny->keys[0]] = tiny->nodes[0];
+        trie->nodes[tiny->keys[1]] = tiny->nodes[1];
+        trie->nodes[tiny->keys[2]] = tiny->nodes[2];
+        trie->nodes[tiny->keys[3]] = tiny->nodes[3];
+        trie->nodes[tiny->keys[4]] = tiny->nodes[4];
+        trie->nodes[tiny->keys[5]] = tiny->nodes[5];
+        trie->nodes[tiny->keys[6]] = tiny->nodes[6];
 
         **nodeptr = encode(trie, TRIE);
         *nodeptr = &trie->nodes[cc];
 
         stash(tiny, sizeof(*tiny));
+
+        COUNT(promotions);
     }
 
     return false;
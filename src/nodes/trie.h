@@ -14,7 +14,7 @@ struct TRIE
     JP nodes[256];
 };
 
-static bool _trie_lookup(JP *node, uchar cc)
+static inline bool _trie_lookup(JP *node, uchar cc)
 {
     struct TRIE *trie = (struct TRIE *)decode(*node);
 
@@ -23,7 +23,14 @@ static bool _trie_lookup(JP *node, uchar cc)
     return true;
 }
 
-static bool _trie_insert(JP **nodeptr, uchar cc)
+static inline JP *_trie_find(JP node, uchar cc)
+{
+    struct TRIE *trie = (struct TRIE *)decode(node);
+
+    return &trie->nodes[cc];
+}
+
+static inline bool _trie_insert(JP **nodeptr, uchar cc)
 {
     struct TRIE *trie = (struct TRIE *)decode(**nodeptr);
 
@@ -0,0 +1,275 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Persistent mode:
+ *
+ * The nodes of a persistent judy array are carved from a shared
+ * mapping of its file. An image header at the start of the file
+ * records the root, the address the file was mapped at, and the
+ * allocator state: the unused rest and a free list per size class.
+ *
+ * Nodes keep referring to each other by address, so lookups decode
+ * JPs exactly like in memory. The file is mapped at its recorded
+ * address again on open. Only if that range is taken is it mapped
+ * elsewhere and every node JP relocated once.
+ *
+ * A range of HEAP_RESERVE bytes is reserved up front, so the file
+ * can grow in place without moving the nodes already mapped.
+ */
+
+#define HEAP_MAGIC "JUDYHEAP"
+
+#define HEAP_HEADER 4096
+#define HEAP_GROW (1ull << 24)
+#define HEAP_RESERVE (1ull << 36)
+
+struct IMAGE
+{
+    char magic[8];
+
+    // address of the mapping the nodes refer to
+    uint64_t base;
+
+    // bytes of the file and offset of its unused rest
+    uint64_t size;
+    uint64_t bump;
+
+    uint64_t root;
+
+    // stashed nodes per size class
+    uint64_t free[CLASSES];
+};
+
+struct HEAP
+{
+    pthread_mutex_t lock;
+
+    int fd;
+
+    // the image is at the start of the mapping
+    struct IMAGE *image;
+};
+
+static void _heap_grow(struct HEAP *heap, size_t size)
+{
+    struct IMAGE *image = heap->image;
+
+    size_t from = image->size;
+    size_t to = from;
+
+    while (to < image->bump + size)
+        to += to < HEAP_GROW ? to : HEAP_GROW;
+
+    void *mem = (uchar *)image + from;
+
+    if (to > HEAP_RESERVE || ftruncate(heap->fd, to) < 0 ||
+        mmap(mem, to - from, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, heap->fd, from) == MAP_FAILED)
+    {
+        fprintf(stderr, "[error]: failed to grow persistent judy array to %zu bytes!\n", to);
+        exit(1);
+    }
+
+    image->size = to;
+}
+
+void *_heap_claim(struct HEAP *heap, int cls, size_t size)
+{
+    pthread_mutex_lock(&heap->lock);
+
+    struct IMAGE *image = heap->image;
+
+    void *ptr = (void *)image->free[cls];
+
+    if (ptr)
+    {
+        image->free[cls] = *(uint64_t *)ptr;
+    }
+    else
+    {
+        if (image->bump + size > image->size)
+            _heap_grow(heap, size);
+
+        ptr = (uchar *)image + image->bump;
+        image->bump += size;
+    }
+
+    pthread_mutex_unlock(&heap->lock);
+
+    return ptr;
+}
+
+void _heap_stash(struct HEAP *heap, int cls, void *ptr)
+{
+    pthread_mutex_lock(&heap->lock);
+
+    *(uint64_t *)ptr = heap->image->free[cls];
+    heap->image->free[cls] = (uint64_t)ptr;
+
+    pthread_mutex_unlock(&heap->lock);
+}
+
+/**
+ * moves the node in `slot` and all nodes below it by `delta` bytes.
+ */
+static void _heap_relocate(JP *slot, intptr_t delta)
+{
+    if (!decode(*slot))
+        return;
+
+    *slot += delta;
+
+    // the wrapped node and the table of a stride node are moved with it,
+    // the slots the table mirrors are moved below the wrapped node
+    if (typeof(*slot) == STRIDE)
+    {
+        struct STRIDE *stride = (struct STRIDE *)decode(*slot);
+
+        stride->nodes = (JP *)((uchar *)stride->nodes + delta);
+
+        for (int i = 0; i < stride->size * stride->size; ++i)
+            if (stride->nodes[i])
+                stride->nodes[i] += delta;
+
+        _heap_relocate(&stride->node, delta);
+        return;
+    }
+
+    uchar keys[256];
+    JP *slots[256];
+
+    int n = _node_children(*slot, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+        if (keys[i])
+            _heap_relocate(slots[i], delta);
+}
+
+static void _heap_rebase(struct IMAGE *image)
+{
+    intptr_t delta = (uintptr_t)image - image->base;
+
+    _heap_relocate(&image->root, delta);
+
+    for (int cls = 0; cls < CLASSES; ++cls)
+    {
+        for (uint64_t *link = &image->free[cls]; *link; link = (uint64_t *)*link)
+            *link += delta;
+    }
+
+    image->base = (uintptr_t)image;
+}
+
+bool judy_open_persistent(judy_t *judy, const char *path)
+{
+    judy_create(judy);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+        return false;
+
+    struct IMAGE image = {};
+
+    ssize_t len = pread(fd, &image, sizeof(image), 0);
+
+    bool fresh = len == 0;
+
+    if (!fresh && (len != sizeof(image) || memcmp(image.magic, HEAP_MAGIC, 8)))
+    {
+        close(fd);
+
+        errno = EINVAL;
+        return false;
+    }
+
+    size_t size = fresh ? HEAP_GROW : image.size;
+
+    int flag = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+    // the address is only a hint if the range is taken
+    void *base = mmap((void *)image.base, HEAP_RESERVE, PROT_NONE, flag, -1, 0);
+
+    if (base == MAP_FAILED || (fresh && ftruncate(fd, size) < 0) ||
+        mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        int err = errno;
+
+        if (base != MAP_FAILED)
+            munmap(base, HEAP_RESERVE);
+
+        close(fd);
+
+        errno = err;
+        return false;
+    }
+
+    struct HEAP *heap = calloc(1, sizeof(struct HEAP));
+
+    pthread_mutex_init(&heap->lock, NULL);
+
+    heap->fd = fd;
+    heap->image = base;
+
+    if (fresh)
+    {
+        memcpy(heap->image->magic, HEAP_MAGIC, 8);
+
+        heap->image->base = (uintptr_t)base;
+        heap->image->size = size;
+        heap->image->bump = HEAP_HEADER;
+    }
+    else if (heap->image->base != (uintptr_t)base)
+    {
+        _heap_rebase(heap->image);
+    }
+
+    judy->root = heap->image->root;
+    judy->heap = heap;
+
+    return true;
+}
+
+bool judy_sync(judy_t *judy)
+{
+    if (!judy->heap)
+        return true;
+
+    struct IMAGE *image = judy->heap->image;
+
+    image->root = judy->root;
+
+    return msync(image, image->size, MS_SYNC) == 0;
+}
+
+void _heap_close(judy_t *judy)
+{
+    struct HEAP *heap = judy->heap;
+
+    judy_sync(judy);
+
+    munmap(heap->image, HEAP_RESERVE);
+    close(heap->fd);
+
+    pthread_mutex_destroy(&heap->lock);
+    free(heap);
+
+    judy->heap = NULL;
+}
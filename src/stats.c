@@ -0,0 +1,100 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+struct FRAME
+{
+    JP node;
+    size_t depth;
+};
+
+void judy_stats(judy_t *judy, judy_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (judy->table)
+        stats->bytes += 65536 * sizeof(JP);
+
+    stats->bytes += _filter_bytes(judy);
+
+    size_t len = 0;
+    size_t cap = 256;
+
+    struct FRAME *stack = malloc(cap * sizeof(struct FRAME));
+
+    if (judy->root)
+        stack[len++] = (struct FRAME){judy->root, 0};
+
+    while (len)
+    {
+        struct FRAME frame = stack[--len];
+
+        uchar keys[256];
+        JP *slots[256];
+
+        size_t bytes = judy->frozen ? _freeze_node_bytes(frame.node) : _node_size(frame.node);
+
+        switch (typeof(frame.node))
+        {
+        case TINY:
+            ++stats->tiny;
+            stats->tiny_bytes += bytes;
+            break;
+        case TRIE:
+            ++stats->trie;
+            stats->trie_bytes += bytes;
+            break;
+        case PACKED:
+            ++stats->packed;
+            stats->packed_bytes += bytes;
+            break;
+        case STRIDE:
+            ++stats->stride;
+            stats->stride_bytes += bytes;
+            break;
+        case LEAF:
+            ++stats->leaf;
+            stats->leaf_bytes += bytes;
+            stats->keys += ((struct LEAF *)decode(frame.node))->count;
+            break;
+        }
+
+        // the arena of a frozen array is counted as a whole,
+        // with its padding and without shared subtrees twice
+        if (!judy->frozen)
+            stats->bytes += bytes;
+
+        if (frame.depth > stats->depth)
+            stats->depth = frame.depth;
+
+        int n = _node_children(frame.node, keys, slots);
+
+        if (len + n > cap)
+        {
+            cap = 2 * (len + n);
+            stack = realloc(stack, cap * sizeof(struct FRAME));
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (!keys[i])
+                ++stats->keys;
+            else
+                stack[len++] = (struct FRAME){*slots[i], frame.depth + 1};
+        }
+    }
+
+    free(stack);
+
+    if (judy->frozen)
+        stats->bytes += _freeze_bytes(judy);
+}
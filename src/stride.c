@@ -0,0 +1,353 @@
+#include "judy.h"
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes/trie.h"
+#include "nodes/tiny.h"
+#include "nodes/leaf.h"
+#include "nodes/packed.h"
+#include "nodes/stride.h"
+#include "nodes/node.h"
+
+/**
+ * Stride nodes of mutable arrays:
+ *
+ * Inserts which burst a bucket or promote a node check whether the
+ * node above has become dense enough to be wrapped in a stride node,
+ * see _stride_grow(). The alphabet is limited to STRIDE_TABLE chars
+ * so the table fits into a node of the largest size class.
+ *
+ * The wrapped node stays the authoritative copy. Whoever changes
+ * a node two levels below a stride node through the wrapped node
+ * refreshes the row of its first char in the table afterwards, an
+ * insert which went through the table writes the slot back into
+ * the wrapped node instead. A stride node is only dropped once its
+ * wrapped node is empty or the array is compacted or frozen.
+ */
+
+int _stride_select(JP node, uint64_t *bits, int alphabet)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    uchar next[256];
+    JP *nexts[256];
+
+    if (typeof(node) == LEAF || typeof(node) == STRIDE)
+        return 0;
+
+    memset(bits, 0, 4 * sizeof(uint64_t));
+
+    int n = _node_children(node, keys, slots);
+    int pairs = 0;
+
+    // every char of both levels is part of the alphabet
+    if ((n && !keys[0] ? n - 1 : n) > alphabet)
+        return 0;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (!keys[i])
+            continue;
+
+        if (typeof(*slots[i]) == LEAF)
+            return 0;
+
+        bits[keys[i] >> 6] |= 1ull << (keys[i] & 63);
+
+        int m = _node_children(*slots[i], next, nexts);
+
+        if ((m && !next[0] ? m - 1 : m) > alphabet)
+            return 0;
+
+        for (int j = 0; j < m; ++j)
+        {
+            if (!next[j])
+                continue;
+
+            bits[next[j] >> 6] |= 1ull << (next[j] & 63);
+            ++pairs;
+        }
+    }
+
+    int size = 0;
+
+    for (int i = 0; i < 4; ++i)
+        size += __builtin_popcountll(bits[i]);
+
+    if (size > alphabet || pairs < STRIDE_MIN || 2 * pairs < size * size)
+        return 0;
+
+    return size;
+}
+
+JP _stride_make(void *mem, JP *nodes, JP node, const uint64_t *bits, int size)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    uchar next[256];
+    JP *nexts[256];
+
+    struct STRIDE *stride = mem;
+
+    stride->node = node;
+    stride->nodes = nodes;
+    stride->size = size;
+
+    memcpy(stride->bits, bits, sizeof(stride->bits));
+
+    for (int i = 1; i < 4; ++i)
+        stride->rank[i] = stride->rank[i - 1] + __builtin_popcountll(bits[i - 1]);
+
+    int n = _node_children(node, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (!keys[i])
+            continue;
+
+        int row = _stride_rank(stride, keys[i]) * size;
+        int m = _node_children(*slots[i], next, nexts);
+
+        for (int j = 0; j < m; ++j)
+            if (next[j])
+                stride->nodes[row + _stride_rank(stride, next[j])] = *nexts[j];
+    }
+
+    return encode(mem, STRIDE);
+}
+
+void _stride_sync(JP node, uchar cc)
+{
+    uchar next[256];
+    JP *nexts[256];
+
+    struct STRIDE *stride = (struct STRIDE *)decode(node);
+
+    int r0 = _stride_rank(stride, cc);
+
+    if (r0 < 0)
+        return;
+
+    JP *row = &stride->nodes[r0 * stride->size];
+
+    memset(row, 0, stride->size * sizeof(JP));
+
+    JP *child = _node_find(stride->node, cc);
+
+    if (!child || !*child)
+        return;
+
+    // a bucket has no second level, so the row stays empty
+    int m = _node_children(*child, next, nexts);
+
+    for (int j = 0; j < m; ++j)
+    {
+        int r1 = next[j] ? _stride_rank(stride, next[j]) : -1;
+
+        if (r1 >= 0)
+            row[r1] = *nexts[j];
+    }
+}
+
+void _stride_refresh(JP node)
+{
+    struct STRIDE *stride = (struct STRIDE *)decode(node);
+
+    for (int cc = 1; cc < 256; ++cc)
+        if (stride->bits[cc >> 6] & (1ull << (cc & 63)))
+            _stride_sync(node, cc);
+}
+
+bool _stride_grow(JP *slot)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    JP node = *slot;
+    JP base = typeof(node) == STRIDE ? _stride_base(node) : node;
+
+    uint64_t bits[4];
+    int size = _stride_select(base, bits, STRIDE_TABLE);
+
+    if (!size)
+        return false;
+
+    bool same = base != node && !memcmp(bits, ((struct STRIDE *)decode(node))->bits, sizeof(bits));
+    bool changed = !same;
+
+    // lookups skip the children of a stride node,
+    // so stride nodes among them would be wasted
+    int n = _node_children(base, keys, slots);
+
+    for (int i = 0; i < n; ++i)
+    {
+        JP child = *slots[i];
+
+        if (keys[i] && typeof(child) == STRIDE)
+        {
+            *slots[i] = _stride_base(child);
+            _stride_free(child);
+
+            changed = true;
+        }
+    }
+
+    if (same)
+        return changed;
+
+    struct STRIDE *stride = claim(STRIDE_NODE);
+
+    stride->claimed = true;
+
+    *slot = _stride_make(stride, claim(STRIDE_NODES), base, bits, size);
+
+    if (base != node)
+        _stride_free(node);
+
+    return true;
+}
+
+bool _stride_grow_at(judy_t *judy, const uchar *key, int depth)
+{
+    JP *slot = &judy->root;
+
+    // the stride nodes two levels and one level above
+    JP above[2] = {};
+
+    for (int i = 0; i < depth; ++i)
+    {
+        above[0] = above[1];
+        above[1] = typeof(*slot) == STRIDE ? *slot : (JP)0;
+
+        slot = _node_find(*slot, key[i]);
+
+        if (!slot || !*slot)
+            return false;
+    }
+
+    if (above[1] || !_stride_grow(slot))
+        return false;
+
+    if (above[0])
+        _stride_sync(above[0], key[depth - 2]);
+
+    // the nodes of depth 2 are in the root accelerator,
+    // a stride node of depth 1 may have unwrapped some
+    if (judy->table && depth == 1)
+        for (int cc = 0; cc < 256; ++cc)
+            _table_update(judy, (uchar[]){key[0], cc, '\0'});
+
+    if (depth == 2)
+        _table_update(judy, key);
+
+    ++judy->version;
+
+    return true;
+}
+
+void _stride_touch(judy_t *judy, const uchar *key, int depth)
+{
+    if (depth < 2)
+        return;
+
+    JP *slot = &judy->root;
+
+    for (int i = 0; i < depth - 2; ++i)
+    {
+        slot = _node_find(*slot, key[i]);
+
+        if (!slot || !*slot)
+            return;
+    }
+
+    if (typeof(*slot) == STRIDE)
+        _stride_sync(*slot, key[depth - 2]);
+}
+
+void _stride_strip(JP *slot)
+{
+    if (typeof(*slot) == STRIDE)
+    {
+        JP node = *slot;
+
+        *slot = _stride_base(node);
+        _stride_free(node);
+    }
+
+    int pos = 0;
+    uchar cc;
+
+    for (JP *child; (child = _node_next(*slot, &pos, &cc));)
+        if (cc)
+            _stride_strip(child);
+}
+
+struct MIRROR
+{
+    JP *slot;
+
+    // the slot of a stride node two levels above, which mirrors `slot`
+    JP *mirror;
+};
+
+void _stride_grow_all(JP *root)
+{
+    uchar keys[256];
+    JP *slots[256];
+
+    uchar next[256];
+    JP *nexts[256];
+
+    size_t len = 0;
+    size_t max = 256;
+
+    struct MIRROR *stack = malloc(max * sizeof(struct MIRROR));
+
+    stack[len++] = (struct MIRROR){root, NULL};
+
+    while (len)
+    {
+        struct MIRROR item = stack[--len];
+
+        _stride_grow(item.slot);
+
+        if (item.mirror)
+            *item.mirror = *item.slot;
+
+        JP node = *item.slot;
+        bool wrapped = typeof(node) == STRIDE;
+
+        int n = _node_children(node, keys, slots);
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (!keys[i])
+                continue;
+
+            // the nodes two levels below a stride node are grown instead
+            int m = wrapped ? _node_children(*slots[i], next, nexts) : 1;
+
+            if (len + m > max)
+            {
+                max = 2 * (len + m);
+                stack = realloc(stack, max * sizeof(struct MIRROR));
+            }
+
+            if (!wrapped)
+            {
+                stack[len++] = (struct MIRROR){slots[i], NULL};
+                continue;
+            }
+
+            for (int j = 0; j < m; ++j)
+                if (next[j])
+                    stack[len++] = (struct MIRROR){nexts[j], _stride_find(node, (uchar[]){keys[i], next[j]})};
+        }
+    }
+
+    free(stack);
+}
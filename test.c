@@ -1,8 +1,21 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include "src/judy.h"
 
+static void count(void *ctx, int tid, const uchar *key, size_t len, void *val)
+{
+    __atomic_add_fetch((size_t *)ctx, 1, __ATOMIC_RELAXED);
+}
+
+static void evict(void *ctx, const uchar *key, void *val)
+{
+    ++*(size_t *)ctx;
+}
+
 int main()
 {
     judy_t judy;
@@ -17,7 +30,451 @@ int main()
 
     assert(res == &judy);
 
+    judy_accelerate(&judy);
+
+    judy_insert(&judy, (uchar *)"a", &res);
+
+    assert(judy_lookup(&judy, (uchar *)"abc") == &judy);
+    assert(judy_lookup(&judy, (uchar *)"a") == &res);
+    assert(judy_lookup(&judy, (uchar *)"ab") == NULL);
+
+    judy_finger_t finger;
+
+    judy_finger_init(&finger, &judy);
+
+    judy_insert_finger(&finger, (uchar *)"abd", &finger);
+
+    assert(judy_lookup_finger(&finger, (uchar *)"abc") == &judy);
+    assert(judy_lookup_finger(&finger, (uchar *)"abd") == &finger);
+
+    judy_adaptive(&judy, 1 << 16);
+
+    for (int i = 0; i < 1 << 16; ++i)
+        assert(judy_lookup(&judy, (uchar *)"abc") == &judy);
+    assert(judy_lookup(&judy, (uchar *)"abd") == &finger);
+
+    judy_compact(&judy);
+
+    assert(judy_lookup(&judy, (uchar *)"abc") == &judy);
+    assert(judy_lookup(&judy, (uchar *)"a") == &res);
+    assert(judy_lookup_finger(&finger, (uchar *)"abd") == &finger);
+
+    const uchar *keys[] = {(uchar *)"x", (uchar *)"xy", (uchar *)"abc", (uchar *)"x"};
+    void *vals[] = {&keys[0], &keys[1], &keys[2], &keys[3]};
+
+    judy_insert_batch(&judy, keys, vals, 4);
+
+    assert(judy_lookup(&judy, (uchar *)"x") == &keys[3]);
+    assert(judy_lookup(&judy, (uchar *)"xy") == &keys[1]);
+    assert(judy_lookup(&judy, (uchar *)"abc") == &keys[2]);
+    assert(judy_lookup(&judy, (uchar *)"abd") == &finger);
+
+    size_t n = 0;
+
+    judy_parallel_foreach(&judy, count, &n, 4);
+
+    assert(n == 5);
+
+    judy_freeze(&judy);
+
+    assert(judy_lookup(&judy, (uchar *)"xy") == &keys[1]);
+    assert(judy_lookup(&judy, (uchar *)"ab") == NULL);
+
+    judy_remove(&judy, (uchar *)"xy");
+
+    assert(judy_lookup(&judy, (uchar *)"xy") == NULL);
+    assert(judy_lookup(&judy, (uchar *)"x") == &keys[3]);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+
+    n = 0;
+
+    judy_cache(&judy, 1 << 16, evict, &n);
+
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%d", i * 7919);
+
+        judy_insert(&judy, key, &judy);
+
+        // evictions never take the key just inserted
+        assert(judy_lookup(&judy, key) == &judy);
+    }
+
+    judy_stats_t stats;
+
+    judy_stats(&judy, &stats);
+
+    assert(n && stats.bytes <= 1 << 16);
+    assert(stats.keys + n == 1 << 12);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+
+    // enough keys below one prefix to burst the bucket
+    for (int i = 0; i < 64; ++i)
+    {
+        uchar key[64];
+
+        snprintf((char *)key, sizeof(key), "prefix/%d/%0*d", i, i % 48, i);
+
+        judy_insert(&judy, key, &keys[i % 4]);
+    }
+
+    judy_remove(&judy, (uchar *)"prefix/7/0000007");
+
+    assert(judy_lookup(&judy, (uchar *)"prefix/7/0000007") == NULL);
+    assert(judy_lookup(&judy, (uchar *)"prefix/63/000000000000063") == &keys[3]);
+    assert(judy_lookup(&judy, (uchar *)"prefix/6") == NULL);
+
+    judy_stats(&judy, &stats);
+
+    assert(stats.keys == 63 && stats.leaf);
+
+    judy_remove_prefix(&judy, (uchar *)"prefix/6");
+
+    assert(judy_lookup(&judy, (uchar *)"prefix/63/000000000000063") == NULL);
+    assert(judy_lookup(&judy, (uchar *)"prefix/5/00005") == &keys[1]);
+
+    judy_stats(&judy, &stats);
+
+    assert(stats.keys == 58);
+
+    judy_remove_prefix(&judy, (uchar *)"p");
+
+    assert(judy.root == 0);
+
+    judy_insert(&judy, (uchar *)"a.com", &keys[0]);
+    judy_insert(&judy, (uchar *)"b.com", &keys[0]);
+    judy_insert(&judy, (uchar *)"b.org", &keys[1]);
+
+    judy_minimize(&judy);
+
+    assert(judy_lookup(&judy, (uchar *)"a.com") == &keys[0]);
+    assert(judy_lookup(&judy, (uchar *)"b.org") == &keys[1]);
+    assert(judy_lookup(&judy, (uchar *)"a.org") == NULL);
+
+    judy_insert(&judy, (uchar *)"a.com", &keys[2]);
+
+    assert(judy_lookup(&judy, (uchar *)"b.com") == &keys[0]);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+
+    // dense enough in the first two chars for a stride node
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%04x", i * 40503 % 65536);
+
+        judy_insert(&judy, key, &keys[i % 4]);
+    }
+
+    judy_filter(&judy, 10);
+    judy_freeze(&judy);
+    judy_stats(&judy, &stats);
+
+    assert(stats.stride && stats.keys == 1 << 12);
+    assert(judy_lookup(&judy, (uchar *)"0000") == &keys[0]);
+    assert(judy_lookup(&judy, (uchar *)"00") == NULL);
+    assert(judy_lookup(&judy, (uchar *)"0") == NULL);
+
+    // grows the filter beyond the keys it was built for
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%05x", i);
+
+        judy_insert(&judy, key, &keys[i % 4]);
+        judy_remove(&judy, key + 1);
+    }
+
+    assert(judy_lookup(&judy, (uchar *)"00fff") == &keys[3]);
+    assert(judy_lookup(&judy, (uchar *)"0fff") == NULL);
+    assert(judy_lookup(&judy, (uchar *)"9e37") == &keys[1]);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+
+    // the same keys get a stride node without freezing
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%04x", i * 40503 % 65536);
+
+        judy_insert(&judy, key, &keys[i % 4]);
+    }
+
+    judy_stats(&judy, &stats);
+
+    assert(stats.stride && stats.keys == 1 << 12);
+
+    // every other key moves one level down below the stride node
+    judy_finger_init(&finger, &judy);
+
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%04x", i * 40503 % 65536);
+
+        if (i % 2)
+            continue;
+
+        judy_remove(&judy, key);
+
+        key[4] = 'g';
+        key[5] = '\0';
+
+        judy_insert_finger(&finger, key, &keys[i % 4]);
+    }
+
+    judy_remove_prefix(&judy, (uchar *)"a");
+
+    size_t left = 0;
+
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[16];
+
+        snprintf((char *)key, sizeof(key), "%04xg", i * 40503 % 65536);
+
+        void *val = key[0] == 'a' ? NULL : &keys[i % 4];
+
+        left += val != NULL;
+
+        assert(judy_lookup(&judy, key) == (i % 2 ? NULL : val));
+
+        key[4] = '\0';
+
+        assert(judy_lookup(&judy, key) == (i % 2 ? val : NULL));
+    }
+
+    judy_compact(&judy);
+    judy_stats(&judy, &stats);
+
+    assert(stats.stride && stats.keys == left);
+    assert(judy_lookup(&judy, (uchar *)"9e37") == &keys[1]);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+    judy_filter(&judy, 10);
+
+    // a batch large enough for the radix pass storing a prefix of its keys
+    uchar prefixed[40][4];
+    const uchar *batch[40];
+    void *values[40];
+
+    for (int i = 0; i < 40; ++i)
+    {
+        snprintf((char *)prefixed[i], sizeof(prefixed[i]), i ? "a%d" : "a", i);
+
+        batch[i] = prefixed[i];
+        values[i] = &keys[i % 4];
+    }
+
+    judy_insert_batch(&judy, batch, values, 40);
+
+    assert(judy_lookup(&judy, (uchar *)"a") == &keys[0]);
+    assert(judy_lookup(&judy, (uchar *)"a39") == &keys[3]);
+    assert(judy_lookup(&judy, (uchar *)"a40") == NULL);
+
+    judy_delete(&judy);
+
+    judy_create(&judy);
+
+    // a single long key is a record instead of a node per char
+    uchar record[1024];
+
+    memset(record, 'r', sizeof(record) - 1);
+    record[sizeof(record) - 1] = '\0';
+
+    judy_insert(&judy, record, &keys[0]);
+    judy_stats(&judy, &stats);
+
+    assert(stats.leaf == 1 && stats.tiny == 0 && stats.bytes == 2048 && stats.leaf_bytes == 2048);
+
+    record[512] = '\0';
+
+    judy_insert(&judy, record, &keys[1]);
+
+    assert(judy_lookup(&judy, record) == &keys[1]);
+
+    record[512] = 'r';
+
+    assert(judy_lookup(&judy, record) == &keys[0]);
+
+    judy_delete(&judy);
+
+    judy1_t set;
+
+    judy1_create(&set);
+
+    assert(judy1_set(&set, (uchar *)"abc"));
+    assert(judy1_set(&set, (uchar *)"ab"));
+    assert(!judy1_set(&set, (uchar *)"abc"));
+
+    assert(judy1_test(&set, (uchar *)"abc"));
+    assert(judy1_test(&set, (uchar *)"ab"));
+    assert(!judy1_test(&set, (uchar *)"a"));
+    assert(!judy1_test(&set, (uchar *)"abcd"));
+
+    assert(judy1_unset(&set, (uchar *)"ab"));
+    assert(!judy1_unset(&set, (uchar *)"ab"));
+    assert(judy1_test(&set, (uchar *)"abc"));
+
+    judy1_delete(&set);
+
+    assert(judy_open_persistent(&judy, "test.judy"));
+
+    judy_insert(&judy, (uchar *)"persistent", (void *)0x40);
+    judy_delete(&judy);
+
+    assert(judy_open_persistent(&judy, "test.judy"));
+    assert(judy_lookup(&judy, (uchar *)"persistent") == (void *)0x40);
+
+    judy_delete(&judy);
+
+    unlink("test.judy");
+
+    uchar uuid[16] = {0};
+
+    judy_create(&judy);
+
+    for (int i = 0; i < 256; ++i)
+    {
+        uuid[i % 16] = i;
+        judy_insert16(&judy, uuid, (void *)(uintptr_t)(8 * i + 8));
+    }
+
+    assert(judy_lookup16(&judy, uuid) == (void *)(uintptr_t)(8 * 255 + 8));
+
+    uuid[0] = 1;
+    assert(judy_lookup16(&judy, uuid) == NULL);
+
+    judy_delete16(&judy);
+
+    judy_counters_t counters;
+
+    judy_counters_reset();
+    judy_counters_get(&counters);
+
+    assert(counters.claims[0] == 0 && counters.visits[1] == 0);
+
+#ifdef JUDY_COUNTERS
+    judy_create(&judy);
+
+    // 17 keys burst the root bucket into a TINY node of 7 chars
+    // and the 8th char promotes it to a TRIE node
+    for (int i = 0; i < 11; ++i)
+    {
+        uchar key[8];
+
+        snprintf((char *)key, sizeof(key), "a%d", i);
+
+        judy_insert(&judy, key, &keys[0]);
+    }
+
+    judy_insert(&judy, (uchar *)"b", &keys[1]);
+    judy_insert(&judy, (uchar *)"c", &keys[1]);
+    judy_insert(&judy, (uchar *)"d", &keys[1]);
+    judy_insert(&judy, (uchar *)"e", &keys[1]);
+    judy_insert(&judy, (uchar *)"f", &keys[1]);
+    judy_insert(&judy, (uchar *)"g", &keys[1]);
+
+    judy_counters_get(&counters);
+
+    assert(counters.bursts == 1 && counters.promotions == 0);
+
+    judy_insert(&judy, (uchar *)"h", &keys[2]);
+    judy_counters_get(&counters);
+
+    assert(counters.bursts == 1 && counters.promotions == 1);
+    assert(counters.length[1] == 7 && counters.length[2] == 11);
+    assert(counters.expands == 0 && counters.chain[0] == 18);
+
+    judy_counters_reset();
+
+    // the hit steps through the TRIE node into the bucket of "a",
+    // the miss finds an empty TRIE slot and then an empty bucket
+    assert(judy_lookup(&judy, (uchar *)"a5") == &keys[0]);
+    assert(judy_lookup(&judy, (uchar *)"z") == NULL);
+
+    judy_counters_get(&counters);
+
+    assert(counters.visits[2] == 2 && counters.hits[2] == 1 && counters.misses[2] == 1);
+    assert(counters.visits[0] == 2 && counters.hits[0] == 1 && counters.misses[0] == 1);
+    assert(counters.visits[1] == 0);
+
+    // a suffix too long even for a record expands into a chain
+    // of TINY nodes until the rest of it fits into one
+    uchar chained[2100];
+
+    memset(chained, 'x', sizeof(chained) - 1);
+    chained[sizeof(chained) - 1] = '\0';
+
+    judy_counters_reset();
+    judy_insert(&judy, chained, &keys[3]);
+    judy_counters_get(&counters);
+
+    // 79 expands of one insert are a single chain in [64, 128)
+    assert(counters.expands == 79 && counters.chain[7] == 1 && counters.chain[0] == 0);
+
+    assert(judy_lookup(&judy, chained) == &keys[3]);
+
+    judy_delete(&judy);
+
+    // removals leave the TRIE node of "1" with 6 children, too many
+    // to demote it right away, but the adaptive mode demotes it once
+    // it turns cold
+    judy_create(&judy);
+
+    for (int i = 0; i < 1 << 12; ++i)
+    {
+        uchar key[8];
+
+        snprintf((char *)key, sizeof(key), "%03x", i);
+
+        judy_insert(&judy, key, &keys[0]);
+    }
+
+    for (int i = 0x160; i < 0x200; ++i)
+    {
+        uchar key[8];
+
+        snprintf((char *)key, sizeof(key), "%03x", i);
+
+        judy_remove(&judy, key);
+    }
+
+    judy_adaptive(&judy, 0);
+    judy_counters_reset();
+
+    // one lookup of "105" is sampled, then a period of samples decays
+    for (int i = 0; i < 64; ++i)
+        assert(judy_lookup(&judy, (uchar *)"105") == &keys[0]);
+    for (int i = 0; i < 64 * 4096; ++i)
+        assert(judy_lookup(&judy, (uchar *)"005") == &keys[0]);
+
+    judy_counters_get(&counters);
+
+    assert(counters.promotions == 0 && counters.demotions == 1);
+    assert(judy_lookup(&judy, (uchar *)"15f") == &keys[0]);
+    assert(judy_lookup(&judy, (uchar *)"160") == NULL);
+
     judy_delete(&judy);
+#endif
 
     return 0;
 }
\ No newline at end of file
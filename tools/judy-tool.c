@@ -0,0 +1,304 @@
+/**
+ * judy-tool: loads a key file into a judy array, runs a lookup
+ * workload from a second file and reports throughput and the
+ * memory footprint of the tree.
+ *
+ * build it together with all translation units of src/ and -lpthread.
+ *
+ *   judy-tool [-l] [-a] [-c] [-f] [-b BITS] KEYS [QUERIES]
+ *
+ *   -l  records are length-prefixed (4 byte little-endian length)
+ *       instead of newline-separated
+ *   -a  enable the root accelerator
+ *   -c  run judy_compact after loading
+ *   -f  run judy_freeze after loading
+ *   -b  enable the negative lookup filter with BITS bits per key
+ *
+ * Both files are mapped copy-on-write and every key is terminated
+ * in place, so keys are streamed into the tree without copying.
+ * Newline-separated records may end in "\r\n" as well as "\n".
+ * Keys must not contain '\0'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/judy.h"
+
+struct STREAM
+{
+    uchar *pos;
+    uchar *end;
+
+    bool prefixed;
+
+    // length of the record at `pos` which might have been
+    // overwritten by the terminator of the previous key
+    uint32_t len;
+
+    // copy of a last key which can't be terminated in place
+    uchar *tail;
+};
+
+static uint32_t _load32(const uchar *ptr)
+{
+    return ptr[0] | ptr[1] << 8 | ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+static void _stream_open(struct STREAM *stream, const char *path, bool prefixed)
+{
+    int fd = open(path, O_RDONLY);
+
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "[error]: can't open %s\n", path);
+        exit(1);
+    }
+
+    memset(stream, 0, sizeof(*stream));
+
+    stream->prefixed = prefixed;
+
+    if (st.st_size)
+    {
+        int prot = PROT_READ | PROT_WRITE;
+        int flag = MAP_PRIVATE;
+
+        uchar *data = mmap(NULL, st.st_size, prot, flag, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            fprintf(stderr, "[error]: can't mmap %s\n", path);
+            exit(1);
+        }
+
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+        stream->pos = data;
+        stream->end = data + st.st_size;
+
+        if (prefixed && st.st_size >= 4)
+            stream->len = _load32(data);
+    }
+
+    close(fd);
+}
+
+/**
+ * the last key ends at the end of the mapping,
+ * so it gets copied in order to terminate it.
+ */
+static uchar *_stream_tail(struct STREAM *stream, uchar *key, size_t len)
+{
+    if (!stream->prefixed && len && key[len - 1] == '\r')
+        --len;
+
+    free(stream->tail);
+
+    stream->tail = malloc(len + 1);
+    memcpy(stream->tail, key, len);
+    stream->tail[len] = '\0';
+
+    stream->pos = stream->end;
+
+    return stream->tail;
+}
+
+/**
+ * the next '\0'-terminated key or NULL at the end of the stream.
+ */
+static uchar *_stream_next(struct STREAM *stream)
+{
+    if (stream->pos >= stream->end)
+        return NULL;
+
+    uchar *key;
+
+    if (!stream->prefixed)
+    {
+        key = stream->pos;
+
+        uchar *nl = memchr(key, '\n', stream->end - key);
+
+        if (!nl)
+            return _stream_tail(stream, key, stream->end - key);
+
+        // a CRLF line break ends the key at its '\r'
+        if (nl > key && nl[-1] == '\r')
+            nl[-1] = '\0';
+
+        *nl = '\0';
+        stream->pos = nl + 1;
+
+        return key;
+    }
+
+    if (stream->end - stream->pos < 4)
+        return NULL;
+
+    key = stream->pos + 4;
+
+    uchar *next = key + stream->len;
+
+    if (next >= stream->end)
+        return _stream_tail(stream, key, stream->end - key);
+
+    // read the next length before its first byte is overwritten
+    if (stream->end - next >= 4)
+        stream->len = _load32(next);
+
+    *next = '\0';
+    stream->pos = next;
+
+    return key;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * `total` divided by `n` or 0 for no keys.
+ */
+static double _per(double total, size_t n)
+{
+    return n ? total / n : 0;
+}
+
+static void _usage(void)
+{
+    fprintf(stderr, "usage: judy-tool [-l] [-a] [-c] [-f] [-b BITS] KEYS [QUERIES]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    bool prefixed = false;
+    bool accelerate = false;
+    bool compact = false;
+    bool freeze = false;
+    int filter = 0;
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "lacfb:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'l':
+            prefixed = true;
+            break;
+        case 'a':
+            accelerate = true;
+            break;
+        case 'c':
+            compact = true;
+            break;
+        case 'f':
+            freeze = true;
+            break;
+        case 'b':
+            filter = atoi(optarg);
+            break;
+        default:
+            _usage();
+        }
+    }
+
+    if (optind >= argc)
+        _usage();
+
+    judy_t judy;
+
+    judy_create(&judy);
+
+    if (accelerate)
+        judy_accelerate(&judy);
+
+    if (filter)
+        judy_filter(&judy, filter);
+
+    struct STREAM stream;
+
+    _stream_open(&stream, argv[optind], prefixed);
+
+    size_t n = 0;
+
+    double t0 = _now();
+
+    for (uchar *key; (key = _stream_next(&stream)); ++n)
+        judy_insert(&judy, key, &judy);
+
+    double t1 = _now();
+
+    printf("load:    %zu keys in %.3fs, %.2f Mkeys/s, %.0fns/key\n",
+           n, t1 - t0, n / (t1 - t0) * 1e-6, _per(t1 - t0, n) * 1e9);
+
+    if (compact)
+    {
+        judy_compact(&judy);
+
+        printf("compact: %.3fs\n", _now() - t1);
+    }
+
+    if (freeze)
+    {
+        double t2 = _now();
+
+        judy_freeze(&judy);
+
+        printf("freeze:  %.3fs\n", _now() - t2);
+    }
+
+    if (optind + 1 < argc)
+    {
+        _stream_open(&stream, argv[optind + 1], prefixed);
+
+        size_t m = 0, hits = 0;
+
+        double t2 = _now();
+
+        for (uchar *key; (key = _stream_next(&stream)); ++m)
+            hits += judy_lookup(&judy, key) != NULL;
+
+        double t3 = _now();
+
+        printf("lookup:  %zu keys in %.3fs, %.2f Mkeys/s, %.0fns/key, %.1f%% hits\n",
+               m, t3 - t2, m / (t3 - t2) * 1e-6, _per(t3 - t2, m) * 1e9, _per(100.0 * hits, m));
+    }
+
+    judy_stats_t stats;
+
+    judy_stats(&judy, &stats);
+
+    printf("tree:    %zu keys, depth %zu\n", stats.keys, stats.depth);
+    printf("memory:  %zu bytes, %.1f bytes/key\n", stats.bytes, _per(stats.bytes, stats.keys));
+    printf("  tiny:  %zu nodes, %zu bytes\n", stats.tiny, stats.tiny_bytes);
+    printf("  trie:  %zu nodes, %zu bytes\n", stats.trie, stats.trie_bytes);
+    printf("  leaf:  %zu buckets, %zu bytes\n", stats.leaf, stats.leaf_bytes);
+
+    if (freeze)
+    {
+        printf("  packed: %zu nodes, %zu bytes\n", stats.packed, stats.packed_bytes);
+        printf("  stride: %zu nodes, %zu bytes\n", stats.stride, stats.stride_bytes);
+    }
+
+    judy_delete(&judy);
+
+    return 0;
+}